@@ -97,7 +97,7 @@ enum NickCoreFlag
 /* A registered nickname.
  * It matters that Base is here before Extensible (it is inherited by Serializable) 
  */
-class CoreExport NickAlias : public Serializable, public Extensible, public Flags<NickNameFlag>
+class CoreExport NickAlias : public Serializable, public Extensible, public Flags<NickNameFlag, NS_END>
 {
 	Anope::string vhost_ident, vhost_host, vhost_creator;
 	time_t vhost_created;
@@ -185,7 +185,7 @@ class CoreExport NickAlias : public Serializable, public Extensible, public Flag
  * account's display.
  * It matters that Base is here before Extensible (it is inherited by Serializable)
  */
-class CoreExport NickCore : public Serializable, public Extensible, public Flags<NickCoreFlag>
+class CoreExport NickCore : public Serializable, public Extensible, public Flags<NickCoreFlag, NI_END>
 {
  public:
  	/* Name of the account. Find(display)->nc == this. */
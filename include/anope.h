@@ -75,9 +75,19 @@ namespace Anope
 		inline bool equals_cs(const std::string &_str) const { return this->_string == _str; }
 		inline bool equals_cs(const string &_str) const { return this->_string == _str._string; }
 
-		inline bool equals_ci(const char *_str) const { return ci::string(this->_string.c_str()) == _str; }
-		inline bool equals_ci(const std::string &_str) const { return ci::string(this->_string.c_str()) == _str.c_str(); }
-		inline bool equals_ci(const string &_str) const { return ci::string(this->_string.c_str()) == _str._string.c_str(); }
+		inline bool equals_ci(const char *_str) const { return equals_ci(_str, strlen(_str)); }
+		inline bool equals_ci(const std::string &_str) const { return equals_ci(_str.c_str(), _str.length()); }
+		inline bool equals_ci(const string &_str) const { return equals_ci(_str.c_str(), _str.length()); }
+		inline bool equals_ci(const char *_str, size_type n) const
+		{
+			if (this->_string.length() != n)
+				return false;
+			const char *s = this->_string.c_str();
+			for (size_type i = 0; i < n; ++i)
+				if (casemap_upper[static_cast<unsigned char>(s[i])] != casemap_upper[static_cast<unsigned char>(_str[i])])
+					return false;
+			return true;
+		}
 
 		/**
 		 * Inequality operators, exact opposites of the above.
@@ -297,9 +307,13 @@ namespace Anope
 
 	struct hash
 	{
+		/* FNV-1a of the case folded string, folded a character at a time so nothing needs to be allocated */
 		inline size_t operator()(const string &s) const
 		{
-			return std::tr1::hash<std::string>()(s.lower().str());
+			size_t h = 2166136261U;
+			for (const char *p = s.c_str(), *end = p + s.length(); p != end; ++p)
+				h = (h ^ casemap_upper[static_cast<unsigned char>(*p)]) * 16777619U;
+			return h;
 		}
 	};
 
@@ -469,6 +483,11 @@ namespace Anope
 	 */
 	extern bool IsFile(const Anope::string &file);
 
+	/** Renames a file, replacing the file it is renamed to if it exists
+	 * @return true on success
+	 */
+	extern CoreExport bool ReplaceFile(const Anope::string &from, const Anope::string &to);
+
 	/** Converts a string into seconds
 	 * @param s The string, eg 3d
 	 * @return The time represented by the string, eg 259,200
@@ -513,6 +532,58 @@ namespace Anope
 	 * @return the IP if it was found, else the host
 	 */
 	extern Anope::string Resolve(const Anope::string &host, int type);
+
+	/** A mask prepared for matching many strings against, with the same rules as Anope::Match.
+	 * The mask is lowercased and split on '*' once, so matching only has to search for each
+	 * literal segment in the string. Keep one of these around instead of calling Match in a loop.
+	 */
+	class CoreExport CompiledMask
+	{
+		/* A run of the pattern between two '*'s */
+		struct Segment
+		{
+			size_t offset, length;
+			/* Whether this segment contains a '?' */
+			bool wild;
+		};
+
+		Anope::string mask;
+		/* The regex, if the mask is one */
+		Anope::string expression;
+		/* The mask, lowercased if not case sensitive */
+		Anope::string pattern;
+		std::vector<Segment> segments;
+		bool case_sensitive, use_regex, is_regex;
+		/* Whether the pattern starts or ends with a '*' */
+		bool star_start, star_end;
+	 public:
+		CompiledMask();
+
+		/** Constructor
+		 * @param mask The pattern (e.g. foo*bar)
+		 * @param case_sensitive Whether or not the match is case sensitive
+		 * @param use_regex Whether or not to try regex, if the mask is surrounded by slashes
+		 */
+		CompiledMask(const string &mask, bool case_sensitive = false, bool use_regex = false);
+
+		/** Compiles a new pattern
+		 * @param mask The pattern (e.g. foo*bar)
+		 * @param case_sensitive Whether or not the match is case sensitive
+		 * @param use_regex Whether or not to try regex, if the mask is surrounded by slashes
+		 */
+		void Compile(const string &mask, bool case_sensitive = false, bool use_regex = false);
+
+		/** Get the pattern this was compiled from
+		 * @return The pattern
+		 */
+		const string &GetMask() const;
+
+		/** Check whether a string matches this mask
+		 * @param str The string to check
+		 * @return true if it matches
+		 */
+		bool Matches(const string &str) const;
+	};
 }
 
 /** sepstream allows for splitting token seperated lists.
@@ -752,25 +823,22 @@ template<typename T, typename O> inline T anope_dynamic_static_cast(O ptr)
 /*************************************************************************/
 
 /** Class with the ability to keep flags on items, they should extend from this
- * where T is an enum.
+ * where T is an enum and Size is more than the largest value of T that is used.
+ * The flags are kept in the object itself, so they cost no allocation.
  */
-template<typename T> class Flags
+template<typename T, size_t Size = 32> class Flags
 {
-	std::vector<bool> flags_values;
+	std::bitset<Size> flags_values;
 	static const Anope::string *flags_strings;
 
  public:
 	/** Add a flag to this item
-	 * @param value The flag
+	 * @param value The flag, ignored if it is out of range
 	 */
 	void SetFlag(T value)
 	{
-		if (value < 0)
-			return;
-
-		if (static_cast<unsigned>(value) >= flags_values.size())
-			flags_values.resize(value + 1);
-		flags_values[value] = true;
+		if (static_cast<size_t>(value) < Size)
+			flags_values[value] = true;
 	}
 
 	/** Remove a flag from this item
@@ -778,7 +846,7 @@ template<typename T> class Flags
 	 */
 	void UnsetFlag(T value)
 	{
-		if (value >= 0 && static_cast<unsigned>(value) < flags_values.size())
+		if (static_cast<size_t>(value) < Size)
 			flags_values[value] = false;
 	}
 
@@ -788,7 +856,7 @@ template<typename T> class Flags
 	 */
 	bool HasFlag(T value) const
 	{
-		if (value >= 0 && static_cast<unsigned>(value) < flags_values.size())
+		if (static_cast<size_t>(value) < Size)
 			return flags_values[value];
 		return false;
 	}
@@ -798,18 +866,14 @@ template<typename T> class Flags
 	 */
 	size_t FlagCount() const
 	{
-		size_t c = 0;
-		for (unsigned i = 0; i < flags_values.size(); ++i)
-			if (flags_values[i])
-				++c;
-		return c;
+		return flags_values.count();
 	}
 
 	/** Unset all of the flags
 	 */
 	void ClearFlags()
 	{
-		flags_values.clear();
+		flags_values.reset();
 	}
 
 	static const Anope::string* GetFlagStrings()
@@ -31,6 +31,8 @@ struct UserContainer : public Extensible
 };
 
 typedef std::list<UserContainer *> CUserList;
+/* Where each user is in a CUserList */
+typedef std::tr1::unordered_map<const User *, CUserList::iterator> CUserIndex;
 
 enum ChannelFlag
 {
@@ -61,6 +63,8 @@ class CoreExport Channel : public Base, public Extensible, public Flags<ChannelF
 
 	/* Users in the channel */
 	CUserList users;
+	/* Where each user is in users, kept up to date by JoinUser and DeleteUser */
+	CUserIndex users_index;
 
 	/* Current topic of the channel */
 	Anope::string topic;
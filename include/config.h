@@ -413,6 +413,10 @@ class CoreExport ServerConfig
 	time_t ExpireTimeout;
 	/* How long to wait for something from the uplink, this is passed to select() */
 	time_t ReadTimeout;
+	/* Use the socket engine in edge-triggered mode, if it supports it */
+	bool EdgeTriggered;
+	/* The most threads in the thread pool */
+	unsigned MaxThreads;
 	/* How often to send program errors */
 	time_t WarningTimeout;
 	/* How long to process things such as timers to see if there is anything to calll */
@@ -485,7 +489,7 @@ class CoreExport ServerConfig
 	/* Don't allow nicks to use /ns group to regroup nicks */
 	bool NSNoGroupChange;
 	/* Default flags for newly registered nicks */
-	Flags<NickCoreFlag> NSDefFlags;
+	Flags<NickCoreFlag, NI_END> NSDefFlags;
 	/* All languages Anope is aware about */
 	Anope::string Languages;
 	/* Default language used by services */
@@ -546,7 +550,7 @@ class CoreExport ServerConfig
 	/* Core ChanServ modules */
 	Anope::string ChanCoreModules;
 	/* Default flags for newly registered channels */
-	Flags<ChannelInfoFlag> CSDefFlags;
+	Flags<ChannelInfoFlag, CI_END> CSDefFlags;
 	/* Max number of channels a user can own */
 	unsigned CSMaxReg;
 	/* Time before a channel expires */
@@ -589,7 +593,7 @@ class CoreExport ServerConfig
 	/* Core BotServ modules */
 	Anope::string BotCoreModules;
 	/* Default BotServ flags */
-	Flags<BotServFlag> BSDefFlags;
+	Flags<BotServFlag, BS_END> BSDefFlags;
 	/* How long before botserv forgets a user. This is used for flood kickers etc */
 	time_t BSKeepData;
 	/* Min number of users to have in the channel before the service bot joins */
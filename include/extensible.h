@@ -33,12 +33,105 @@ template<typename T> struct CoreExport ExtensibleItemClass : T, ExtensibleItem
 	ExtensibleItemClass(const T& t) : T(t) { }
 };
 
+/** A key to attach items to Extensibles with. Each name is given a small number, its slot,
+ * the first time it is registered, and items are found by that rather than by comparing names.
+ * Modules should keep one of these for each of their keys instead of passing the name around.
+ * Slots are never reused, so a module that is reloaded gets the same slots back.
+ */
+class CoreExport ExtensibleKey
+{
+	unsigned slot;
+
+ public:
+	/** Registers a key, or finds the key already registered with this name
+	 * @param name The name of the key
+	 */
+	explicit ExtensibleKey(const Anope::string &name);
+
+	inline unsigned GetSlot() const { return this->slot; }
+
+	inline const Anope::string &GetName() const { return GetName(this->slot); }
+
+	/** Get the name of the key registered with a slot
+	 * @param slot The slot
+	 * @return The name
+	 */
+	static const Anope::string &GetName(unsigned slot);
+};
+
 /* Used to attach arbitrary objects to this object using unique keys */
 class CoreExport Extensible
 {
  private:
- 	typedef std::map<Anope::string, ExtensibleItem *> extensible_map;
-	extensible_map *extension_items;
+	/* The items on this object with their slots, sorted by slot. Objects rarely have
+	 * more than a few items, so this is kept small rather than indexed directly by slot.
+	 */
+	typedef std::vector<std::pair<unsigned, ExtensibleItem *> > extensible_items;
+	extensible_items *extension_items;
+
+	extensible_items::iterator Search(unsigned slot) const
+	{
+		extensible_items::iterator it = this->extension_items->begin(), it_end = this->extension_items->end();
+		while (it != it_end && it->first < slot)
+			++it;
+		return it;
+	}
+
+	/* Objects only have a few items, so it is quicker to compare their names than to find the slot of the key */
+	extensible_items::iterator Search(const Anope::string &key) const
+	{
+		extensible_items::iterator it = this->extension_items->begin(), it_end = this->extension_items->end();
+		while (it != it_end && ExtensibleKey::GetName(it->first) != key)
+			++it;
+		return it;
+	}
+
+	ExtensibleItem *Get(unsigned slot) const
+	{
+		if (this->extension_items)
+		{
+			extensible_items::iterator it = this->Search(slot);
+			if (it != this->extension_items->end() && it->first == slot)
+				return it->second;
+		}
+
+		return NULL;
+	}
+
+	bool Has(unsigned slot) const
+	{
+		if (this->extension_items)
+		{
+			extensible_items::iterator it = this->Search(slot);
+			return it != this->extension_items->end() && it->first == slot;
+		}
+
+		return false;
+	}
+
+	void Extend(unsigned slot, ExtensibleItem *p)
+	{
+		this->Shrink(slot);
+		if (!this->extension_items)
+			this->extension_items = new extensible_items();
+		this->extension_items->insert(this->Search(slot), std::make_pair(slot, p));
+	}
+
+	bool Shrink(unsigned slot)
+	{
+		if (!this->extension_items)
+			return false;
+
+		extensible_items::iterator it = this->Search(slot);
+		if (it == this->extension_items->end() || it->first != slot)
+			return false;
+
+		ExtensibleItem *item = it->second;
+		this->extension_items->erase(it);
+		if (item != NULL)
+			item->OnDelete();
+		return true;
+	}
 
  public:
 	/** Default constructor
@@ -52,7 +145,7 @@ class CoreExport Extensible
 	{
 		if (extension_items)
 		{
-			for (extensible_map::iterator it = extension_items->begin(), it_end = extension_items->end(); it != it_end; ++it)
+			for (extensible_items::iterator it = extension_items->begin(), it_end = extension_items->end(); it != it_end; ++it)
 				if (it->second)
 					it->second->OnDelete();
 			delete extension_items;
@@ -61,21 +154,36 @@ class CoreExport Extensible
 
 	/** Extend an Extensible class.
 	 *
-	 * @param key The key parameter is an arbitary string which identifies the extension data
+	 * @param key The key which identifies the extension data
 	 * @param p This parameter is a pointer to an ExtensibleItem or ExtensibleItemBase derived class
 	 *
-	 * You must provide a key to store the data as via the parameter 'key'.
-	 * The data will be inserted into the map. If the data already exists, you may not insert it
-	 * twice, Extensible::Extend will return false in this case.
+	 * If the key already has data it is deleted and replaced.
+	 */
+	void Extend(const ExtensibleKey &key, ExtensibleItem *p)
+	{
+		this->Extend(key.GetSlot(), p);
+	}
+
+	/** Extend an Extensible class, registering the key if it hasn't been.
 	 *
-	 * @return Returns true on success, false if otherwise
+	 * @param key The key parameter is an arbitary string which identifies the extension data
+	 * @param p This parameter is a pointer to an ExtensibleItem or ExtensibleItemBase derived class
 	 */
 	void Extend(const Anope::string &key, ExtensibleItem *p)
 	{
-		this->Shrink(key);
-		if (!extension_items)
-			extension_items = new extensible_map();
-		(*this->extension_items)[key] = p;
+		this->Extend(ExtensibleKey(key), p);
+	}
+
+	/** Shrink an Extensible class.
+	 *
+	 * @param key The key which identifies the extension data
+	 *
+	 * The data for the key is removed from this object and deleted.
+	 * @return Returns true on success, false if there was no data for the key.
+	 */
+	bool Shrink(const ExtensibleKey &key)
+	{
+		return this->Shrink(key.GetSlot());
 	}
 
 	/** Shrink an Extensible class.
@@ -88,22 +196,21 @@ class CoreExport Extensible
 	 */
 	bool Shrink(const Anope::string &key)
 	{
-		if (!extension_items)
+		if (!this->extension_items)
 			return false;
 
-		extensible_map::iterator it = this->extension_items->find(key);
-		if (it != this->extension_items->end())
-		{
-			if (it->second != NULL)
-				it->second->OnDelete();
-			/* map::size_type map::erase( const key_type& key );
-			 * returns the number of elements removed, std::map
-			 * is single-associative so this should only be 0 or 1
-			 */
-			return this->extension_items->erase(key) > 0;
-		}
+		extensible_items::iterator it = this->Search(key);
+		return it != this->extension_items->end() && this->Shrink(it->first);
+	}
 
-		return false;
+	/** Get an extension item.
+	 *
+	 * @param key The key which identifies the extension data
+	 * @return The item found
+	 */
+	template<typename T> T GetExt(const ExtensibleKey &key) const
+	{
+		return anope_dynamic_static_cast<T>(this->Get(key.GetSlot()));
 	}
 
 	/** Get an extension item.
@@ -115,7 +222,7 @@ class CoreExport Extensible
 	{
 		if (this->extension_items)
 		{
-			extensible_map::const_iterator it = this->extension_items->find(key);
+			extensible_items::iterator it = this->Search(key);
 			if (it != this->extension_items->end())
 				return anope_dynamic_static_cast<T>(it->second);
 		}
@@ -123,6 +230,16 @@ class CoreExport Extensible
 		return NULL;
 	}
 
+	/** Check if an extension item exists.
+	 *
+	 * @param key The key which identifies the extension data
+	 * @return True if the item was found.
+	 */
+	bool HasExt(const ExtensibleKey &key) const
+	{
+		return this->Has(key.GetSlot());
+	}
+
 	/** Check if an extension item exists.
 	 *
 	 * @param key The key parameter is an arbitary string which identifies the extension data
@@ -130,7 +247,7 @@ class CoreExport Extensible
 	 */
 	bool HasExt(const Anope::string &key) const
 	{
-		return this->extension_items != NULL && this->extension_items->count(key) > 0;
+		return this->extension_items != NULL && this->Search(key) != this->extension_items->end();
 	}
 
 	/** Get a list of all extension items names.
@@ -141,8 +258,8 @@ class CoreExport Extensible
 	void GetExtList(std::deque<Anope::string> &list) const
 	{
 		if (extension_items)
-			for (extensible_map::const_iterator it = extension_items->begin(), it_end = extension_items->end(); it != it_end; ++it)
-				list.push_back(it->first);
+			for (extensible_items::const_iterator it = extension_items->begin(), it_end = extension_items->end(); it != it_end; ++it)
+				list.push_back(ExtensibleKey::GetName(it->first));
 	}
 };
 
@@ -28,6 +28,15 @@ namespace Anope
 	/* Casemap in use by Anope. ci::string's comparation functions use this (and thus Anope::string) */
 	extern std::locale casemap;
 
+	/* The casemap's toupper() of every character, which is what case insensitive
+	 * comparisons and hashes use so they do not need to go through the locale
+	 */
+	extern CoreExport unsigned char casemap_upper[256];
+
+	/** Rebuilds casemap_upper, this must be called after changing casemap
+	 */
+	extern CoreExport void RebuildCaseMap();
+
 	/* ASCII case insensitive ctype. */
 	template<typename char_type>
 	class ascii_ctype : public std::ctype<char_type>
@@ -25,7 +25,7 @@ namespace Mail
 	extern CoreExport bool Validate(const Anope::string &email);
 
 	/* A email message being sent */
-	class Message : public Thread
+	class Message : public Task
 	{
 	 private:
 	 	Anope::string sendmail_path;
@@ -38,7 +38,7 @@ namespace Mail
 
 		bool success;
 	 public:
-	 	/** Construct this message. Once constructed call Thread::Start to launch the mail sending.
+	 	/** Construct this message. Once constructed pass it to ThreadPool::Submit to send the mail.
 		 * @param sf Config->SendFrom
 		 * @param mailto Name of person being mailed (u->nick, nc->display, etc)
 		 * @param addr Destination address to mail
@@ -49,7 +49,7 @@ namespace Mail
 
 		~Message();
 
-		/* Called from within the thread to actually send the mail */
+		/* Called from one of the pool's threads to actually send the mail */
 		void Run() anope_override;
 	};
 
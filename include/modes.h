@@ -252,7 +252,7 @@ class CoreExport ChannelModeStatus : public ChannelMode
 };
 
 /* The status a user has on a channel (+v, +h, +o) etc */
-class CoreExport ChannelStatus : public Flags<ChannelModeName>
+class CoreExport ChannelStatus : public Flags<ChannelModeName, CMODE_END * 2>
 {
  public:
 	Anope::string BuildCharPrefixList() const;
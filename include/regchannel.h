@@ -211,7 +211,7 @@ struct CoreExport LogSetting : Serializable
 };
 
 /* It matters that Base is here before Extensible (it is inherited by Serializable) */
-class CoreExport ChannelInfo : public Serializable, public Extensible, public Flags<ChannelInfoFlag>
+class CoreExport ChannelInfo : public Serializable, public Extensible, public Flags<ChannelInfoFlag, CI_END>
 {
  private:
 	Serialize::Reference<NickCore> founder;					/* Channel founder */
@@ -244,7 +244,7 @@ class CoreExport ChannelInfo : public Serializable, public Extensible, public Fl
 
 	/* For BotServ */
 	Serialize::Reference<BotInfo> bi;         /* Bot used on this channel */
-	Flags<BotServFlag> botflags;
+	Flags<BotServFlag, BS_END> botflags;
 	int16_t ttb[TTB_SIZE];                    /* Times to ban for each kicker */
 
 	int16_t capsmin, capspercent;	          /* For CAPS kicker */
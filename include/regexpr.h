@@ -43,5 +43,27 @@ class CoreExport RegexProvider : public Service
 	virtual Regex *Compile(const Anope::string &) = 0;
 };
 
+/** The regexes compiled for Anope::Match, using the configured regex engine. Once
+ * it is full the least recently used regexes are deleted to make room.
+ */
+class CoreExport RegexCache
+{
+ public:
+	/* The most regexes kept at once */
+	static const unsigned MaxSize = 64;
+
+	/** Finds or compiles a regex. The regex belongs to the cache and is only valid
+	 * until the next call to Find or Clear.
+	 * @param expression The expression, without the surrounding slashes
+	 * @return The regex, or NULL if it could not be compiled
+	 */
+	static Regex *Find(const Anope::string &expression);
+
+	/** Deletes all of the cached regexes. This must be done before a module
+	 * providing them is unloaded.
+	 */
+	static void Clear();
+};
+
 #endif // REGEXPR_H
 
@@ -66,8 +66,17 @@ class CoreExport Serializable : public virtual Base
 	std::list<Serializable *>::iterator s_iter;
 	/* The last serialized form of this object commited to the database */
 	Serialize::Data *last_commit;
-	/* The last time this object was commited to the database */
-	time_t last_commit_time;
+	/* The update generation this object was last queued for an update in */
+	unsigned int last_queued;
+
+	/* The current update generation. Modules are told of the first update
+	 * queued for an object in each generation, and not of the rest.
+	 */
+	static unsigned int generation;
+	/* How many updates were passed on to modules, and how many were not
+	 * because the object was already queued in the current generation.
+	 */
+	static unsigned long updates_queued, updates_avoided;
 
 	Serializable();
  protected:
@@ -87,16 +96,15 @@ class CoreExport Serializable : public virtual Base
 	 */
 	void Destroy();
 
-	/** Marks the object as potentially being updated "soon".
+	/** Marks the object as potentially being updated "soon". Modules are only
+	 * told of this once per generation, so calling this often, as Reference
+	 * does every time it is dereferenced, is cheap.
 	 */
 	void QueueUpdate();
 
 	bool IsCached(Serialize::Data *);
 	void UpdateCache(Serialize::Data *);
 
-	bool IsTSCached();
-	void UpdateTS();
-
 	/** Get the type of serializable object this is
 	 * @return The serializable object type
 	 */
@@ -105,6 +113,16 @@ class CoreExport Serializable : public virtual Base
 	virtual void Serialize(Serialize::Data &data) const = 0;
 
 	static const std::list<Serializable *> &GetItems();
+
+	/** Starts a new update generation, so the next update queued for every object
+	 * is passed on to modules again. Database modules call this after they are done
+	 * with the objects queued for them, so changes made after that are queued again,
+	 * and it is called every time around the main loop.
+	 */
+	static void NextGeneration();
+
+	static unsigned long GetUpdatesQueued();
+	static unsigned long GetUpdatesAvoided();
 };
 
 /* A serializable type. There should be one of these classes for each type
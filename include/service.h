@@ -26,6 +26,8 @@ class CoreExport Service : public virtual Base
 {
 	static std::map<Anope::string, std::map<Anope::string, Service *> > Services;
 	static std::map<Anope::string, std::map<Anope::string, Anope::string> > Aliases;
+	/* Incremented whenever a service or alias is added or removed */
+	static unsigned Generation;
  public:
  	static Service *FindService(const Anope::string &t, const Anope::string &n)
 	{
@@ -50,6 +52,15 @@ class CoreExport Service : public virtual Base
 		return NULL;
 	}
 
+	/** Get the current generation of the service maps. This changes whenever a service
+	 * or alias is added or removed, so callers caching the result of FindService can tell
+	 * when they must look again.
+	 */
+	static unsigned GetGeneration()
+	{
+		return Generation;
+	}
+
 	static std::vector<Anope::string> GetServiceKeys(const Anope::string &t)
 	{
 		std::vector<Anope::string> keys;
@@ -64,6 +75,7 @@ class CoreExport Service : public virtual Base
 	{
 		std::map<Anope::string, Anope::string> &smap = Aliases[t];
 		smap[n] = v;
+		++Generation;
 	}
 
 	static void DelAlias(const Anope::string &t, const Anope::string &n)
@@ -72,6 +84,7 @@ class CoreExport Service : public virtual Base
 		smap.erase(n);
 		if (smap.empty())
 			Aliases.erase(t);
+		++Generation;
 	}
 
 	Module *owner;
@@ -96,6 +109,7 @@ class CoreExport Service : public virtual Base
 		if (smap.find(this->name) != smap.end())
 			throw ModuleException("Service " + this->type + " with name " + this->name + " already exists");
 		smap[this->name] = this;
+		++Generation;
 	}
 
 	void Unregister()
@@ -104,6 +118,7 @@ class CoreExport Service : public virtual Base
 		smap.erase(this->name);
 		if (smap.empty())
 			Services.erase(this->type);
+		++Generation;
 	}
 };
 
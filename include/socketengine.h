@@ -20,8 +20,31 @@ class CoreExport SocketEngine
 {
 	static const int DefaultSize = 2; // Uplink, mode stacker
  public:
-	/* Map of sockets */
-	static std::map<int, Socket *> Sockets;
+	/* Sockets, indexed by their file descriptor. Slots of descriptors not in use are NULL */
+	static std::vector<Socket *> Sockets;
+	/* The number of sockets in Sockets */
+	static unsigned NumSockets;
+
+	/** Add a socket to the list of sockets
+	 * @param s The socket
+	 */
+	static void AddSocket(Socket *s);
+
+	/** Remove a socket from the list of sockets
+	 * @param s The socket
+	 */
+	static void DelSocket(Socket *s);
+
+	/** Find a socket by its file descriptor
+	 * @param fd The file descriptor
+	 * @return The socket, or NULL if there is none
+	 */
+	static inline Socket *FindSocket(int fd)
+	{
+		if (fd < 0 || static_cast<unsigned>(fd) >= Sockets.size())
+			return NULL;
+		return Sockets[fd];
+	}
 
 	/** Called to initialize the socket engine
 	 */
@@ -38,6 +61,24 @@ class CoreExport SocketEngine
 	 */
 	static void Change(Socket *s, bool set, SocketFlag flag);
 
+	/* The most times a socket should read or write in one go when it is edge-triggered,
+	 * so one busy socket can not keep the others from being processed
+	 */
+	static const unsigned DrainLimit = 16;
+
+	/** Check whether a socket is edge-triggered. If it is, the engine only reports it
+	 * when it becomes ready, so it must read and write until it would block, or call
+	 * Rearm() if it stops early because it reached the DrainLimit.
+	 * @param s The socket
+	 * @return true if the socket is edge-triggered
+	 */
+	static bool IsEdgeTriggered(Socket *s);
+
+	/** Have an edge-triggered socket reported again if it is still ready
+	 * @param s The socket
+	 */
+	static void Rearm(Socket *s);
+
 	/** Read from sockets and do things
 	 */
 	static void Process();
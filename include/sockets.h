@@ -22,6 +22,8 @@
 #include "anope.h"
 
 #define NET_BUFSIZE 65535
+/* The most segments of a send queue written with one call */
+#define NET_MAXSEGMENTS 16
 
 /** A sockaddr union used to combine IPv4 and IPv6 sockaddrs
  */
@@ -148,6 +150,15 @@ class CoreExport SocketIO
 	virtual int Send(Socket *s, const char *buf, size_t sz);
 	int Send(Socket *s, const Anope::string &buf);
 
+	/** Write several buffers to the socket at once, like writev()
+	 * @param s The socket
+	 * @param bufs The buffers to write, in order
+	 * @param lens The length of each buffer
+	 * @param count The number of buffers
+	 * @return Number of bytes written
+	 */
+	virtual int Send(Socket *s, const char * const *bufs, const size_t *lens, int count);
+
 	/** Accept a connection from a socket
 	 * @param s The socket
 	 * @return The new socket
@@ -242,6 +253,12 @@ class CoreExport Socket : public Flags<SocketFlag>
 	 */
 	virtual bool Process();
 
+	/** Check whether this socket can be edge-triggered, which requires it to read
+	 * and write until it would block. Sockets which can not are always level-triggered.
+	 * @return true if the socket can be edge-triggered
+	 */
+	virtual bool CanEdgeTrigger() const;
+
 	/** Called when there is something to be received for this socket
 	 * @return true on success, false to drop this socket
 	 */
@@ -258,13 +275,123 @@ class CoreExport Socket : public Flags<SocketFlag>
 	virtual void ProcessError();
 };
 
+/** Data waiting to be written to a socket. The data is kept in a list of fixed size
+ * blocks, it is appended to the last block and consumed from the first one, so
+ * neither queueing more data nor dropping what a partial write sent has to move
+ * any of the data that is already queued.
+ */
+class CoreExport SendQueue
+{
+	static const size_t BlockSize = 8192;
+
+	struct Block
+	{
+		char data[BlockSize];
+		/* The first byte not yet consumed, and the end of the data */
+		size_t start, end;
+
+		Block() : start(0), end(0) { }
+	};
+
+	std::deque<Block *> blocks;
+	/* Total amount of data queued */
+	size_t length;
+
+	SendQueue(const SendQueue &);
+	SendQueue &operator=(const SendQueue &);
+
+ public:
+	SendQueue();
+	~SendQueue();
+
+	/** Append data to the end of the queue
+	 * @param data The data
+	 * @param len The length of the data
+	 */
+	void Append(const char *data, size_t len);
+
+	/** Get the data at the front of the queue as a list of contiguous segments,
+	 * which can be written with a single call to SocketIO::Send
+	 * @param segments Filled in with the start of each segment
+	 * @param lens Filled in with the length of each segment
+	 * @param max The maximum number of segments to get
+	 * @return The number of segments
+	 */
+	int GetSegments(const char **segments, size_t *lens, int max) const;
+
+	/** Remove data from the front of the queue
+	 * @param len The amount of data to remove
+	 */
+	void Consume(size_t len);
+
+	/** Remove all data from the queue
+	 */
+	void Clear();
+
+	/** Get the amount of data queued
+	 * @return The length
+	 */
+	size_t Length() const;
+
+	/** Check whether the queue is empty
+	 * @return true if there is nothing queued
+	 */
+	bool Empty() const;
+};
+
+/** Data received from a socket that has not been processed yet. Data is received
+ * directly into the free space at the end of the buffer and consumed from the front
+ * by moving an offset. What is left over is only moved back to the start of the
+ * buffer when more room is needed to receive into.
+ */
+class CoreExport RecvQueue
+{
+	char *buffer;
+	/* The size of buffer, the first byte not yet consumed, and the end of the data */
+	size_t size, start, end;
+
+	RecvQueue(const RecvQueue &);
+	RecvQueue &operator=(const RecvQueue &);
+
+ public:
+	RecvQueue();
+	~RecvQueue();
+
+	/** Make room at the end of the buffer to receive data into
+	 * @param len The minimum amount of room needed
+	 * @param avail Set to the amount of room available, which is at least len
+	 * @return Where to write the data to
+	 */
+	char *Reserve(size_t len, size_t &avail);
+
+	/** Add data written to the space given by Reserve() to the buffer
+	 * @param len The amount of data written
+	 */
+	void Commit(size_t len);
+
+	/** Remove data from the front of the buffer
+	 * @param len The amount of data to remove
+	 */
+	void Consume(size_t len);
+
+	/** Get the data that has not been consumed
+	 * @return The data, which is Length() bytes long
+	 */
+	const char *Data() const;
+
+	/** Get the amount of data that has not been consumed
+	 * @return The length
+	 */
+	size_t Length() const;
+};
+
 class CoreExport BufferedSocket : public virtual Socket
 {
  protected:
 	/* Things to be written to the socket */
-	Anope::string write_buffer;
-	/* Part of a message sent from the server, but not totally received */
-	Anope::string extra_buf;
+	SendQueue write_buffer;
+	/* Data received from the socket, which may end with a partial line */
+	RecvQueue read_buffer;
 	/* How much data was received from this socket on this recv() */
 	int recv_len;
 
@@ -272,6 +399,8 @@ class CoreExport BufferedSocket : public virtual Socket
 	BufferedSocket();
 	virtual ~BufferedSocket();
 
+	bool CanEdgeTrigger() const anope_override;
+
 	/** Called when there is something to be received for this socket
 	 * @return true on success, false to drop this socket
 	 */
@@ -311,23 +440,15 @@ class CoreExport BufferedSocket : public virtual Socket
 class CoreExport BinarySocket : public virtual Socket
 {
  protected:
-	struct DataBlock
-	{
-		char *orig;
-		char *buf;
-		size_t len;
-
-		DataBlock(const char *b, size_t l);
-		~DataBlock();
-	};
-
 	/* Data to be written out */
-	std::deque<DataBlock *> write_buffer;
+	SendQueue write_buffer;
 
  public:
 	BinarySocket();
 	virtual ~BinarySocket();
 
+	bool CanEdgeTrigger() const anope_override;
+
 	/** Called when there is something to be received for this socket
 	 * @return true on success, false to drop this socket
 	 */
@@ -16,7 +16,75 @@
 #include "sockets.h"
 #include "extensible.h"
 
-class CoreExport Thread : public Pipe, public Extensible
+/** Something passed from another thread back to the main thread, to be finished there
+ */
+class CoreExport Completion
+{
+	friend class CompletionQueue;
+
+	/* Whether this is waiting in the queue */
+	bool queued;
+	/* When this was posted, in microseconds */
+	uint64_t posted;
+
+ public:
+	Completion();
+
+	/** Destructor, removes this from the queue if it is still waiting to be run
+	 */
+	virtual ~Completion();
+
+	/** Called on the main thread once this has been posted
+	 */
+	virtual void OnComplete() = 0;
+};
+
+/** Passes completions from other threads to the main thread. Everything posted is run
+ * together once per main loop iteration, and the main loop is woken only by the first
+ * completion posted since the last run, so threads with many results don't cost a write
+ * and a wakeup for each of them.
+ */
+class CoreExport CompletionQueue
+{
+ public:
+	/** Sets up waking the main loop, called once the socket engine is initialized
+	 */
+	static void Init();
+
+	/** Queue a completion to be run on the main thread. Can be called from any thread.
+	 * Posting a completion which is already waiting to be run does nothing, so one
+	 * completion can be posted for every result and will be run once for all of them.
+	 * @param c The completion
+	 */
+	static void Post(Completion *c);
+
+	/** Remove a completion from the queue, if it is in it. Called from the main thread.
+	 * @param c The completion
+	 */
+	static void Cancel(Completion *c);
+
+	/** Run all of the completions posted, called from the main thread
+	 */
+	static void Process();
+
+	/** Get how many completions have been run
+	 */
+	static unsigned long GetCompleted();
+
+	/** Get how many times the main loop has been woken for completions
+	 */
+	static unsigned long GetWakeups();
+
+	/** Get the average time completions have waited to be run, in microseconds
+	 */
+	static unsigned long GetAverageLatency();
+
+	/** Get the longest time a completion has waited to be run, in microseconds
+	 */
+	static unsigned long GetMaxLatency();
+};
+
+class CoreExport Thread : public Completion, public Extensible
 {
  private:
 	/* Set to true to tell the thread to finish and we are waiting for it */
@@ -46,7 +114,8 @@ class CoreExport Thread : public Pipe, public Extensible
 	 */
 	void Exit();
 
-	/** Launch the thread
+	/** Launch the thread. Once Run returns, the thread is posted to the CompletionQueue.
+	 * @throws CoreException if the thread can not be created
 	 */
 	void Start();
 
@@ -55,9 +124,13 @@ class CoreExport Thread : public Pipe, public Extensible
 	 */
 	bool GetExitState() const;
 
-	/** Called when this thread should be joined to
+	/** Called on the main thread once the thread has finished
+	 */
+	void OnComplete() anope_override;
+
+	/** Called when this thread should be joined to, joins to and deletes the thread
 	 */
-	void OnNotify();
+	virtual void OnNotify();
 
 	/** Called when the thread is run.
 	 */
@@ -113,9 +186,95 @@ class CoreExport Condition : public Mutex
 	 */
 	void Wakeup();
 
+	/** Called to wakeup every waiter
+	 */
+	void WakeupAll();
+
 	/** Called to wait for a Wakeup() call
 	 */
 	void Wait();
 };
 
+/** Work to be done by one of the threads of the ThreadPool
+ */
+class CoreExport Task : public Completion
+{
+	friend class ThreadPool;
+	friend class PoolThread;
+
+	/* When this was submitted, in microseconds */
+	uint64_t submitted;
+
+ public:
+	/* Tasks with a higher priority are run first, and ones with the same priority in the order they were submitted */
+	int priority;
+
+	/** Constructor
+	 * @param p The priority of the task
+	 */
+	Task(int p = 0);
+
+	/** Destructor, removes the task from the pool if it is still waiting to be run.
+	 * A task must not be deleted while it is being run, see ThreadPool::Cancel.
+	 */
+	virtual ~Task();
+
+	/** Called from one of the pool's threads to do the work
+	 */
+	virtual void Run() = 0;
+
+	/** Called on the main thread once Run has returned, deletes the task by default
+	 */
+	void OnComplete() anope_override;
+};
+
+/** A pool of threads which run Tasks. Threads are started as tasks are submitted,
+ * up to options:threads, and are kept waiting for more tasks after.
+ */
+class CoreExport ThreadPool
+{
+ public:
+	/** Queue a task to be run by the pool
+	 * @param t The task
+	 */
+	static void Submit(Task *t);
+
+	/** Remove a task from the pool. If the task is being run this waits for it to finish,
+	 * and it will still be completed on the main thread.
+	 * @param t The task
+	 * @return true if the task was waiting to be run and has been removed
+	 */
+	static bool Cancel(Task *t);
+
+	/** Runs everything still queued and stops the threads, called when shutting down
+	 */
+	static void Shutdown();
+
+	/** Get the number of threads in the pool
+	 */
+	static unsigned GetThreads();
+
+	/** Get the number of tasks waiting to be run
+	 */
+	static unsigned GetQueued();
+
+	/** Get the most tasks that have been waiting to be run at once
+	 */
+	static unsigned GetMaxQueued();
+
+	/** Get the number of tasks that have been run
+	 */
+	static unsigned long GetCompleted();
+
+	/** Get how long tasks have waited to be run on average and at most, in microseconds
+	 */
+	static unsigned long GetAverageWait();
+	static unsigned long GetMaxWait();
+
+	/** Get how long tasks have taken to run on average and at most, in microseconds
+	 */
+	static unsigned long GetAverageRun();
+	static unsigned long GetMaxRun();
+};
+
 #endif // THREADENGINE_H
@@ -17,7 +17,13 @@
 
 class CoreExport Timer
 {
+	friend class TimerManager;
+
  private:
+	/** The position of this timer in TimerManager's heap
+	 */
+	size_t heap_index;
+
 	/** The time this was created
 	 */
 	time_t settime;
@@ -88,9 +94,21 @@ class CoreExport Timer
  */
 class CoreExport TimerManager
 {
-	/** A list of timers
+	/** A binary min-heap of timers ordered by their trigger time. Each timer knows
+	 * its own position in the heap, so adding, removing, and rescheduling a timer
+	 * are all O(log n).
 	 */
 	static std::vector<Timer *> Timers;
+
+	/** Place the timer at the given position in the heap and update its index
+	 */
+	static void Place(Timer *t, size_t index);
+
+	/** Move the timer at the given position up or down the heap until it is
+	 * in order again
+	 */
+	static void Reposition(size_t index);
+
  public:
 	/** Add a timer to the list
 	 * @param t A Timer derived class to add
@@ -102,6 +120,11 @@ class CoreExport TimerManager
 	 */
 	static void DelTimer(Timer *t);
 
+	/** Reorders a timer after its trigger time has changed
+	 * @param t The timer
+	 */
+	static void UpdateTimer(Timer *t);
+
 	/** Tick all pending timers
 	 * @param ctime The current time
 	 */
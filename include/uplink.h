@@ -23,13 +23,49 @@ namespace Uplink
 /* This is the socket to our uplink */
 class UplinkSocket : public ConnectionSocket, public BufferedSocket
 {
+	/* Total amount of data queued to be sent */
+	unsigned long bytes_queued;
+	/* Number of times the queue has been flushed */
+	unsigned long flushes;
+	/* The largest the queue has been */
+	size_t peak_sendq;
+
+ protected:
+	/** Queue a message to be sent. Messages are not sent right away, but collected
+	 * until the end of the main loop iteration, or until enough is queued, and then
+	 * flushed together.
+	 */
+	void Write(const char *buffer, size_t l) anope_override;
+
  public:
+	/* The amount of queued data at which the queue is flushed without waiting for the end of the loop */
+	static const size_t FlushThreshold = NET_BUFSIZE;
+
 	UplinkSocket();
 	~UplinkSocket();
 	bool Read(const Anope::string &);
 	void OnConnect();
 	void OnError(const Anope::string &);
 
+	using BufferedSocket::Write;
+
+	/** Send everything queued by Write(). Whatever can not be written right away
+	 * is left for the socket engine to write once the socket becomes writable.
+	 */
+	void Flush();
+
+	/** Get the total amount of data queued to be sent to the uplink
+	 */
+	unsigned long GetBytesQueued() const;
+
+	/** Get how many times the queue has been flushed
+	 */
+	unsigned long GetFlushes() const;
+
+	/** Get the largest size the queue has been
+	 */
+	size_t GetPeakSendQ() const;
+
 	/* A message sent over the uplink socket */
 	class CoreExport Message
 	{
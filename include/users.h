@@ -40,6 +40,8 @@ struct ChannelContainer
 };
 
 typedef std::list<ChannelContainer *> UChannelList;
+/* Where each channel is in a UChannelList */
+typedef std::tr1::unordered_map<const Channel *, UChannelList::iterator> UChannelIndex;
 
 /* Online user and channel data. */
 class CoreExport User : public virtual Base, public Extensible, public CommandReply
@@ -51,7 +53,7 @@ class CoreExport User : public virtual Base, public Extensible, public CommandRe
 	/* If the user is on the access list of the nick theyre on */
 	bool on_access;
 	/* Bitset of mode names the user has set on them */
-	Flags<UserModeName> modes;
+	Flags<UserModeName, UMODE_END * 2> modes;
 	/* Map of user modes and the params this user has */
 	std::map<UserModeName, Anope::string> mode_params;
 	/* NickCore account the user is currently loggged in as, if they are logged in */
@@ -90,6 +92,8 @@ class CoreExport User : public virtual Base, public Extensible, public CommandRe
 
 	/* Channels the user is in */
 	UChannelList chans;
+	/* Where each channel is in chans, kept up to date by Channel::JoinUser and Channel::DeleteUser */
+	UChannelIndex chans_index;
 
 	/* Last time this user sent a memo command used */
 	time_t lastmemosend;
@@ -314,8 +318,6 @@ class CoreExport User : public virtual Base, public Extensible, public CommandRe
 	Anope::string GetModes() const;
 
 	/** Find the channel container for Channel c that the user is on
-	 * This is preferred over using FindUser in Channel, as there are usually more users in a channel
-	 * than channels a user is in
 	 * @param c The channel
 	 * @return The channel container, or NULL
 	 */
@@ -17,15 +17,20 @@
 class CoreExport XLine : public Serializable
 {
 	void InitRegex();
+	void InitMasks();
  public:
 	Anope::string mask;
 	Regex *regex;
+	/* The mask and each part of it, compiled for matching against users */
+	Anope::CompiledMask compiled_mask, compiled_nick, compiled_user, compiled_host, compiled_real;
 	Anope::string by;
 	time_t created;
 	time_t expires;
 	Anope::string reason;
 	XLineManager *manager;
 	Anope::string id;
+	/* When this was added to its manager, relative to the other xlines there */
+	unsigned long added;
 
 	XLine(const Anope::string &mask, const Anope::string &reason = "", const Anope::string &uid = "");
 
@@ -54,6 +59,27 @@ class CoreExport XLineManager : public Service
 	Serialize::Checker<std::vector<XLine *> > xlines;
 	/* Akills can have the same IDs, sometimes */
 	static Serialize::Checker<std::multimap<Anope::string, XLine *, ci::less> > XLinesByUID;
+
+	/* The xlines indexed by the hosts and IPs they can match, if IsHostBased() */
+	typedef std::vector<XLine *> xline_bucket;
+	/* Xlines on a host without wildcards */
+	Anope::hash_map<xline_bucket> hosts;
+	/* Xlines on *.domain, by .domain */
+	Anope::hash_map<xline_bucket> host_suffixes;
+	/* Xlines on an IP or CIDR range, by the address family and whole bytes of the range */
+	std::map<std::string, xline_bucket> ips;
+	/* Xlines which can not be indexed, and are checked against everyone */
+	xline_bucket unindexed;
+	/* Counter for XLine::added */
+	unsigned long added_count;
+	/* When expired xlines were last removed */
+	time_t last_expire;
+
+	void Index(XLine *x);
+	void Unindex(XLine *x);
+	void Expire();
+
+	friend class XLine;
  public:
 	/* List of XLine managers we check users against in XLineManager::CheckAll */
 	static std::list<XLineManager *> XLineManagers;
@@ -154,6 +180,14 @@ class CoreExport XLineManager : public Service
 	 */
 	virtual bool Check(User *u, const XLine *x) = 0;
 
+	/** Check whether this XLineManager matches users by host, like akills. If so, Check() must only
+	 * match a user when the host part of the xline's mask is empty, matches the user's host, or is an
+	 * IP or CIDR range containing the user's IP, unless the xline is a regex. Users are then only
+	 * checked against the xlines which could match their host or IP.
+	 * @return true if the xlines can be indexed by host
+	 */
+	virtual bool IsHostBased() const;
+
 	/** Called when a user matches a xline in this XLineManager
 	 * @param u The user
 	 * @param x The XLine they match
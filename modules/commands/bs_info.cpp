@@ -38,7 +38,7 @@ class CommandBSInfo : public Command
 			buffers.push_back(buf);
 	}
 
-	void CheckOptStr(Anope::string &buf, BotServFlag flag, const char *option, Flags<BotServFlag> &flags, const NickCore *nc)
+	void CheckOptStr(Anope::string &buf, BotServFlag flag, const char *option, Flags<BotServFlag, BS_END> &flags, const NickCore *nc)
 	{
 		if (flags.HasFlag(flag))
 		{
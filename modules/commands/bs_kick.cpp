@@ -576,6 +576,8 @@ class CommandBSKick : public Command
 	}
 };
 
+static ExtensibleKey bandata_key("bs_main_bandata"), userdata_key("bs_main_userdata");
+
 struct BanData : public ExtensibleItem
 {
 	struct Data
@@ -678,12 +680,12 @@ class BanDataPurger : public CallBack
 		{
 			Channel *c = it->second;
 
-			BanData *bd = c->GetExt<BanData *>("bs_main_bandata");
+			BanData *bd = c->GetExt<BanData *>(bandata_key);
 			if (bd != NULL)
 			{
 				bd->purge();
 				if (bd->empty())
-					c->Shrink("bs_main_bandata");
+					c->Shrink(bandata_key);
 			}
 		}
 	}
@@ -696,11 +698,11 @@ class BSKick : public Module
 
 	BanData::Data &GetBanData(User *u, Channel *c)
 	{
-		BanData *bd = c->GetExt<BanData *>("bs_main_bandata");
+		BanData *bd = c->GetExt<BanData *>(bandata_key);
 		if (bd == NULL)
 		{
 			bd = new BanData();
-			c->Extend("bs_main_bandata", bd);
+			c->Extend(bandata_key, bd);
 		}
 
 		return bd->get(u->GetMask());
@@ -712,11 +714,11 @@ class BSKick : public Module
 		if (uc == NULL)
 			return NULL;
 
-		UserData *ud = uc->GetExt<UserData *>("bs_main_userdata");
+		UserData *ud = uc->GetExt<UserData *>(userdata_key);
 		if (ud == NULL)
 		{
 			ud = new UserData();
-			uc->Extend("bs_main_userdata", ud);
+			uc->Extend(userdata_key, ud);
 		}
 
 		return ud;
@@ -777,8 +779,8 @@ class BSKick : public Module
 		{
 			Channel *c = cit->second;
 			for (CUserList::iterator it = c->users.begin(), it_end = c->users.end(); it != it_end; ++it)
-				(*it)->Shrink("bs_main_userdata");
-			c->Shrink("bs_main_bandata");
+				(*it)->Shrink(userdata_key);
+			c->Shrink(bandata_key);
 		}
 	}
 
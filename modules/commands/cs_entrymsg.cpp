@@ -39,6 +39,7 @@ struct EntryMsg : Serializable
 	static Serializable* Unserialize(Serializable *obj, Serialize::Data &data);
 };
 
+static ExtensibleKey entrymsg_key("cs_entrymsg");
 static unsigned MaxEntries = 0;
 
 struct EntryMessageList : Serialize::Checker<std::vector<EntryMsg *> >, ExtensibleItem
@@ -68,11 +69,11 @@ Serializable* EntryMsg::Unserialize(Serializable *obj, Serialize::Data &data)
 		return msg;
 	}
 
-	EntryMessageList *messages = ci->GetExt<EntryMessageList *>("cs_entrymsg");
+	EntryMessageList *messages = ci->GetExt<EntryMessageList *>(entrymsg_key);
 	if (messages == NULL)
 	{
 		messages = new EntryMessageList();
-		ci->Extend("cs_entrymsg", messages);
+		ci->Extend(entrymsg_key, messages);
 	}
 
 	EntryMsg *m = new EntryMsg(ci, screator, smessage);
@@ -85,11 +86,11 @@ class CommandEntryMessage : public Command
  private:
 	void DoList(CommandSource &source, ChannelInfo *ci)
 	{
-		EntryMessageList *messages = ci->GetExt<EntryMessageList *>("cs_entrymsg");
+		EntryMessageList *messages = ci->GetExt<EntryMessageList *>(entrymsg_key);
 		if (messages == NULL)
 		{
 			messages = new EntryMessageList();
-			ci->Extend("cs_entrymsg", messages);
+			ci->Extend(entrymsg_key, messages);
 		}
 
 		if ((*messages)->empty())
@@ -124,11 +125,11 @@ class CommandEntryMessage : public Command
 		
 	void DoAdd(CommandSource &source, ChannelInfo *ci, const Anope::string &message)
 	{
-		EntryMessageList *messages = ci->GetExt<EntryMessageList *>("cs_entrymsg");
+		EntryMessageList *messages = ci->GetExt<EntryMessageList *>(entrymsg_key);
 		if (messages == NULL)
 		{
 			messages = new EntryMessageList();
-			ci->Extend("cs_entrymsg", messages);
+			ci->Extend(entrymsg_key, messages);
 		}
 
 		if (MaxEntries && (*messages)->size() >= MaxEntries)
@@ -143,11 +144,11 @@ class CommandEntryMessage : public Command
 
 	void DoDel(CommandSource &source, ChannelInfo *ci, const Anope::string &message)
 	{
-		EntryMessageList *messages = ci->GetExt<EntryMessageList *>("cs_entrymsg");
+		EntryMessageList *messages = ci->GetExt<EntryMessageList *>(entrymsg_key);
 		if (messages == NULL)
 		{
 			messages = new EntryMessageList();
-			ci->Extend("cs_entrymsg", messages);
+			ci->Extend(entrymsg_key, messages);
 		}
 
 		if (!message.is_pos_number_only())
@@ -164,7 +165,7 @@ class CommandEntryMessage : public Command
 					(*messages)->at(i - 1)->Destroy();
 					(*messages)->erase((*messages)->begin() + i - 1);
 					if ((*messages)->empty())
-						ci->Shrink("cs_entrymsg");
+						ci->Shrink(entrymsg_key);
 					Log(source.IsFounder(ci) ? LOG_COMMAND : LOG_OVERRIDE, source, this, ci) << "to remove a message";
 					source.Reply(_("Entry message \002%i\002 for \002%s\002 deleted."), i, ci->name.c_str());
 				}
@@ -180,13 +181,13 @@ class CommandEntryMessage : public Command
 
 	void DoClear(CommandSource &source, ChannelInfo *ci)
 	{
-		EntryMessageList *messages = ci->GetExt<EntryMessageList *>("cs_entrymsg");
+		EntryMessageList *messages = ci->GetExt<EntryMessageList *>(entrymsg_key);
 		if (messages != NULL)
 		{
 			for (unsigned i = 0; i < (*messages)->size(); ++i)
 				(*messages)->at(i)->Destroy();
 			(*messages)->clear();
-			ci->Shrink("cs_entrymsg");
+			ci->Shrink(entrymsg_key);
 		}
 
 		Log(source.IsFounder(ci) ? LOG_COMMAND : LOG_OVERRIDE, source, this, ci) << "to remove all messages";
@@ -278,7 +279,7 @@ class CSEntryMessage : public Module
 	{
 		if (u && c && c->ci && u->server->IsSynced())
 		{
-			EntryMessageList *messages = c->ci->GetExt<EntryMessageList *>("cs_entrymsg");
+			EntryMessageList *messages = c->ci->GetExt<EntryMessageList *>(entrymsg_key);
 
 			if (messages != NULL)
 				for (unsigned i = 0; i < (*messages)->size(); ++i)
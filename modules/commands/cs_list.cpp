@@ -69,6 +69,7 @@ class CommandCSList : public Command
 		}
 
 		Anope::string spattern = "#" + pattern;
+		Anope::CompiledMask mask(pattern, false, true), smask(spattern, false, true);
 
 		source.Reply(_("List of entries matching \002%s\002:"), pattern.c_str());
 
@@ -86,7 +87,7 @@ class CommandCSList : public Command
 			else if (channoexpire && !ci->HasFlag(CI_NO_EXPIRE))
 				continue;
 
-			if (pattern.equals_ci(ci->name) || ci->name.equals_ci(spattern) || Anope::Match(ci->name, pattern, false, true) || Anope::Match(ci->name, spattern, false, true))
+			if (pattern.equals_ci(ci->name) || ci->name.equals_ci(spattern) || mask.Matches(ci->name) || smask.Matches(ci->name))
 			{
 				if (((count + 1 >= from && count + 1 <= to) || (!from && !to)) && ++nchans <= Config->CSListMax)
 				{
@@ -13,6 +13,8 @@
 
 #include "module.h"
 
+static ExtensibleKey ajoin_key("ns_ajoin_channels");
+
 struct AJoinEntry;
 
 struct AJoinList : Serialize::Checker<std::vector<AJoinEntry *> >, ExtensibleItem
@@ -62,11 +64,11 @@ struct AJoinEntry : Serializable
 
 		if (!obj)
 		{
-			AJoinList *channels = nc->GetExt<AJoinList *>("ns_ajoin_channels");
+			AJoinList *channels = nc->GetExt<AJoinList *>(ajoin_key);
 			if (channels == NULL)
 			{
 				channels = new AJoinList();
-				nc->Extend("ns_ajoin_channels", channels);
+				nc->Extend(ajoin_key, channels);
 			}
 			(*channels)->push_back(aj);
 		}
@@ -79,11 +81,11 @@ class CommandNSAJoin : public Command
 {
 	void DoList(CommandSource &source, NickCore *nc)
 	{
-		AJoinList *channels = nc->GetExt<AJoinList *>("ns_ajoin_channels");
+		AJoinList *channels = nc->GetExt<AJoinList *>(ajoin_key);
 		if (channels == NULL)
 		{
 			channels = new AJoinList();
-			nc->Extend("ns_ajoin_channels", channels);
+			nc->Extend(ajoin_key, channels);
 		}
 
 		if ((*channels)->empty())
@@ -114,11 +116,11 @@ class CommandNSAJoin : public Command
 
 	void DoAdd(CommandSource &source, NickCore *nc, const Anope::string &chan, const Anope::string &key)
 	{
-		AJoinList *channels = nc->GetExt<AJoinList *>("ns_ajoin_channels");
+		AJoinList *channels = nc->GetExt<AJoinList *>(ajoin_key);
 		if (channels == NULL)
 		{
 			channels = new AJoinList();
-			nc->Extend("ns_ajoin_channels", channels);
+			nc->Extend(ajoin_key, channels);
 		}
 
 		unsigned i = 0;
@@ -145,11 +147,11 @@ class CommandNSAJoin : public Command
 
 	void DoDel(CommandSource &source, NickCore *nc, const Anope::string &chan)
 	{
-		AJoinList *channels = nc->GetExt<AJoinList *>("ns_ajoin_channels");
+		AJoinList *channels = nc->GetExt<AJoinList *>(ajoin_key);
 		if (channels == NULL)
 		{
 			channels = new AJoinList();
-			nc->Extend("ns_ajoin_channels", channels);
+			nc->Extend(ajoin_key, channels);
 		}
 
 		unsigned i = 0;
@@ -245,11 +247,11 @@ class NSAJoin : public Module
 		if (!NickServ)
 			return;
 
-		AJoinList *channels = u->Account()->GetExt<AJoinList *>("ns_ajoin_channels");
+		AJoinList *channels = u->Account()->GetExt<AJoinList *>(ajoin_key);
 		if (channels == NULL)
 		{
 			channels = new AJoinList();
-			u->Account()->Extend("ns_ajoin_channels", channels);
+			u->Account()->Extend(ajoin_key, channels);
 		}
 
 		for (unsigned i = 0; i < (*channels)->size(); ++i)
@@ -75,6 +75,8 @@ class CommandNSList : public Command
 
 		list.AddColumn("Nick").AddColumn("Last usermask");
 
+		Anope::CompiledMask mask(pattern, false, true);
+
 		for (nickalias_map::const_iterator it = NickAliasList->begin(), it_end = NickAliasList->end(); it != it_end; ++it)
 		{
 			const NickAlias *na = it->second;
@@ -93,7 +95,7 @@ class CommandNSList : public Command
 			 * Instead we build a nice nick!user@host buffer to compare.
 			 * The output is then generated separately. -TheShadow */
 			Anope::string buf = Anope::printf("%s!%s", na->nick.c_str(), !na->last_usermask.empty() ? na->last_usermask.c_str() : "*@*");
-			if (na->nick.equals_ci(pattern) || Anope::Match(buf, pattern, false, true))
+			if (na->nick.equals_ci(pattern) || mask.Matches(buf))
 			{
 				if (((count + 1 >= from && count + 1 <= to) || (!from && !to)) && ++nnicks <= Config->NSListMax)
 				{
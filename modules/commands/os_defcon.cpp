@@ -34,8 +34,8 @@ bool DefConModesSet = false;
 struct DefconConfig
 {
 	std::vector<std::bitset<32> > DefCon;
-	Flags<ChannelModeName> DefConModesOn;
-	Flags<ChannelModeName> DefConModesOff;
+	Flags<ChannelModeName, CMODE_END * 2> DefConModesOn;
+	Flags<ChannelModeName, CMODE_END * 2> DefConModesOff;
 	std::map<ChannelModeName, Anope::string> DefConModesOnParams;
 
 	int defaultlevel, sessionlimit;
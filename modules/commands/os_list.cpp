@@ -63,11 +63,13 @@ class CommandOSChanList : public Command
 		{
 			source.Reply(_("Channel list:"));
 
+			Anope::CompiledMask mask(pattern, false, true);
+
 			for (channel_map::const_iterator cit = ChannelList.begin(), cit_end = ChannelList.end(); cit != cit_end; ++cit)
 			{
 				Channel *c = cit->second;
 
-				if (!pattern.empty() && !Anope::Match(c->name, pattern, false, true))
+				if (!pattern.empty() && !mask.Matches(c->name))
 					continue;
 				if (!Modes.empty())
 					for (std::list<ChannelModeName>::iterator it = Modes.begin(), it_end = Modes.end(); it != it_end; ++it)
@@ -160,6 +162,8 @@ class CommandOSUserList : public Command
 
 			source.Reply(_("Users list:"));
 
+			Anope::CompiledMask match(pattern);
+
 			for (Anope::map<User *>::const_iterator it = ordered_map.begin(); it != ordered_map.end(); ++it)
 			{
 				User *u2 = it->second;
@@ -167,7 +171,7 @@ class CommandOSUserList : public Command
 				if (!pattern.empty())
 				{
 					Anope::string mask = u2->nick + "!" + u2->GetIdent() + "@" + u2->GetDisplayedHost(), mask2 = u2->nick + "!" + u2->GetIdent() + "@" + u2->host, mask3 = u2->nick + "!" + u2->GetIdent() + "@" + (!u2->ip.empty() ? u2->ip : u2->host);
-					if (!Anope::Match(mask, pattern) && !Anope::Match(mask2, pattern) && !Anope::Match(mask3, pattern))
+					if (!match.Matches(mask) && !match.Matches(mask2) && !match.Matches(mask3))
 						continue;
 					if (!Modes.empty())
 						for (std::list<UserModeName>::iterator mit = Modes.begin(), mit_end = Modes.end(); mit != mit_end; ++mit)
@@ -149,9 +149,30 @@ class CommandOSStats : public Command
 		source.Reply(_("Uplink server: %s"), Me->GetLinks().front()->GetName().c_str());
 		source.Reply(_("Uplink capab: %s"), buf.c_str());
 		source.Reply(_("Servers found: %d"), stats_count_servers(Me->GetLinks().front()));
+		if (UplinkSock)
+		{
+			source.Reply(_("Uplink sendq: %d bytes, peak %lu bytes"), UplinkSock->WriteBufferLen(), static_cast<unsigned long>(UplinkSock->GetPeakSendQ()));
+			source.Reply(_("Uplink writes: %lu bytes queued, %lu flushes"), UplinkSock->GetBytesQueued(), UplinkSock->GetFlushes());
+		}
 		return;
 	}
 
+	void DoStatsUpdates(CommandSource &source)
+	{
+		source.Reply(_("Database updates: %lu queued, %lu skipped as already queued"), Serializable::GetUpdatesQueued(), Serializable::GetUpdatesAvoided());
+	}
+
+	void DoStatsCompletions(CommandSource &source)
+	{
+		source.Reply(_("Thread completions: %lu run after %lu wakeups, waiting %lu us on average and %lu us at most"), CompletionQueue::GetCompleted(), CompletionQueue::GetWakeups(), CompletionQueue::GetAverageLatency(), CompletionQueue::GetMaxLatency());
+	}
+
+	void DoStatsThreadPool(CommandSource &source)
+	{
+		source.Reply(_("Thread pool: %u threads, %u tasks queued (%u at most)"), ThreadPool::GetThreads(), ThreadPool::GetQueued(), ThreadPool::GetMaxQueued());
+		source.Reply(_("Thread pool tasks: %lu run, waiting %lu us on average and %lu us at most, running %lu us on average and %lu us at most"), ThreadPool::GetCompleted(), ThreadPool::GetAverageWait(), ThreadPool::GetMaxWait(), ThreadPool::GetAverageRun(), ThreadPool::GetMaxRun());
+	}
+
 	template<typename T> void GetHashStats(const T& map, size_t& entries, size_t& buckets, size_t& max_chain)
 	{
 		entries = map.size(), buckets = map.bucket_count(), max_chain = 0;
@@ -219,6 +240,13 @@ class CommandOSStats : public Command
 		if (extra.equals_ci("ALL") || extra.equals_ci("HASH"))
 			this->DoStatsHash(source);
 
+		if (extra.equals_ci("ALL"))
+		{
+			this->DoStatsUpdates(source);
+			this->DoStatsCompletions(source);
+			this->DoStatsThreadPool(source);
+		}
+
 		if (!extra.empty() && !extra.equals_ci("ALL") && !extra.equals_ci("AKILL") && !extra.equals_ci("UPLINK") && !extra.equals_ci("HASH"))
 			source.Reply(_("Unknown STATS option \002%s\002."), extra.c_str());
 	}
@@ -242,8 +270,11 @@ class CommandOSStats : public Command
 				" \n"
 				"The \002HASH\002 option displays information about the hash maps.\n"
 				" \n"
-				"The \002ALL\002 displays the user and uptime statistics, and\n"
-				"everything you'd see with the \002UPLINK\002 option."));
+				"The \002ALL\002 displays the user and uptime statistics,\n"
+				"everything you'd see with the \002UPLINK\002 option, and how\n"
+				"many updates to objects were queued for the databases,\n"
+				"how long results from threads waited for the main loop,\n"
+				"and how busy the thread pool is."));
 		return true;
 	}
 };
@@ -0,0 +1,896 @@
+/*
+ * (C) 2003-2012 Anope Team
+ * Contact us at team@anope.org
+ *
+ * Please read COPYING and README for further details.
+ */
+
+/*************************************************************************/
+
+#include "module.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/time.h>
+#endif
+
+/* The layout of a database:
+ *
+ * header         "ANOPEBIN", the version, and the offsets of the string pool and the section table
+ * sections       the objects of each type, one type after another
+ * string pool    the number of strings, then each string's length and text. These are the names of types and fields.
+ * section table  the number of sections, then each section's type name (as an index into the string pool),
+ *                number of objects, offset, and length
+ *
+ * The header and section table use 32 bit little endian integers. Everything else uses variable length
+ * integers, 7 bits per byte, least significant first, with the high bit set on all but the last byte.
+ *
+ * Each object is its length and number of fields, then each field's name (as an index into the string pool),
+ * type, and value. Text values are their length followed by the text, integer values are zigzag encoded.
+ */
+static const char magic[] = "ANOPEBIN";
+static const size_t magic_len = sizeof(magic) - 1;
+static const uint32_t version = 1;
+static const size_t header_len = magic_len + 3 * 4;
+
+/* Builds part of a database in memory */
+class Encoder
+{
+ public:
+	std::string buf;
+
+	void Byte(unsigned char c)
+	{
+		buf += static_cast<char>(c);
+	}
+
+	void Fixed(uint32_t v)
+	{
+		for (unsigned i = 0; i < 4; ++i, v >>= 8)
+			buf += static_cast<char>(v & 0xFF);
+	}
+
+	void Number(unsigned long v)
+	{
+		for (; v >= 0x80; v >>= 7)
+			buf += static_cast<char>((v & 0x7F) | 0x80);
+		buf += static_cast<char>(v);
+	}
+
+	void Signed(long v)
+	{
+		this->Number((static_cast<unsigned long>(v) << 1) ^ (v < 0 ? ~0UL : 0UL));
+	}
+
+	void Text(const char *str, size_t len)
+	{
+		this->Number(len);
+		buf.append(str, len);
+	}
+};
+
+/* Reads part of a database, checking that nothing is read past its end */
+class Decoder
+{
+	const char *p, *end;
+
+ public:
+	Decoder(const char *b, const char *e) : p(b), end(e) { }
+
+	bool AtEnd() const { return p == end; }
+
+	size_t Remaining() const { return end - p; }
+
+	bool Byte(unsigned char &c)
+	{
+		if (p == end)
+			return false;
+		c = *p++;
+		return true;
+	}
+
+	bool Fixed(uint32_t &v)
+	{
+		if (end - p < 4)
+			return false;
+		v = 0;
+		for (unsigned i = 0; i < 4; ++i)
+			v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (i * 8);
+		p += 4;
+		return true;
+	}
+
+	bool Number(unsigned long &v)
+	{
+		v = 0;
+		for (unsigned shift = 0; p < end && shift < sizeof(v) * 8; shift += 7)
+		{
+			unsigned char c = *p++;
+			v |= static_cast<unsigned long>(c & 0x7F) << shift;
+			if (!(c & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	bool Signed(long &v)
+	{
+		unsigned long z;
+		if (!this->Number(z))
+			return false;
+		v = static_cast<long>((z >> 1) ^ (~(z & 1) + 1));
+		return true;
+	}
+
+	bool Bytes(unsigned long len, const char *&str)
+	{
+		if (static_cast<unsigned long>(end - p) < len)
+			return false;
+		str = p;
+		p += len;
+		return true;
+	}
+};
+
+/** Checks whether a value can be stored as an integer and written back out exactly as it was
+ * @param str The value
+ * @param v Set to the value
+ * @return true if the value is an integer
+ */
+static bool ParseInt(const std::string &str, long &v)
+{
+	size_t i = !str.empty() && str[0] == '-' ? 1 : 0;
+	/* No leading zeros or -0 */
+	if (i == str.length() || (str[i] == '0' && str.length() > 1))
+		return false;
+	for (size_t j = i; j < str.length(); ++j)
+		if (str[j] < '0' || str[j] > '9')
+			return false;
+
+	errno = 0;
+	v = strtol(str.c_str(), NULL, 10);
+	return errno != ERANGE;
+}
+
+/** Writes an integer as text
+ * @param v The integer
+ * @param end The end of the buffer to write it to, it is written backwards from here
+ * @return The start of the text
+ */
+static char *FormatInt(long v, char *end)
+{
+	unsigned long u = v < 0 ? ~static_cast<unsigned long>(v) + 1 : v;
+	char *p = end;
+	do
+		*--p = '0' + u % 10;
+	while (u /= 10);
+	if (v < 0)
+		*--p = '-';
+	return p;
+}
+
+/* A database being written */
+struct OutputDatabase
+{
+	struct Section
+	{
+		unsigned name;
+		unsigned long count;
+		Encoder data;
+	};
+
+	std::vector<Anope::string> strings;
+	std::map<Anope::string, unsigned> string_ids;
+	/* A deque so the sections are never copied as more are added */
+	std::deque<Section> sections;
+	std::map<Serialize::Type *, unsigned> section_ids;
+
+	/** Adds a string to the string pool
+	 * @param str The string
+	 * @return Its index in the string pool
+	 */
+	unsigned GetString(const Anope::string &str)
+	{
+		std::map<Anope::string, unsigned>::iterator it = string_ids.find(str);
+		if (it != string_ids.end())
+			return it->second;
+		strings.push_back(str);
+		return string_ids[str] = strings.size() - 1;
+	}
+
+	Section &GetSection(Serialize::Type *stype)
+	{
+		std::map<Serialize::Type *, unsigned>::iterator it = section_ids.find(stype);
+		if (it != section_ids.end())
+			return sections[it->second];
+
+		section_ids[stype] = sections.size();
+		sections.push_back(Section());
+		Section &s = sections.back();
+		s.name = GetString(stype->GetName());
+		s.count = 0;
+		return s;
+	}
+
+	/** Writes the database
+	 * @param name The name of the file
+	 * @return false if the file could not be written
+	 */
+	bool Write(const Anope::string &name)
+	{
+		Encoder header, pool, table;
+
+		pool.Fixed(strings.size());
+		for (unsigned i = 0; i < strings.size(); ++i)
+			pool.Text(strings[i].c_str(), strings[i].length());
+
+		unsigned long offset = header_len;
+		table.Fixed(sections.size());
+		for (unsigned i = 0; i < sections.size(); ++i)
+		{
+			const Section &s = sections[i];
+			table.Fixed(s.name);
+			table.Fixed(s.count);
+			table.Fixed(offset);
+			table.Fixed(s.data.buf.length());
+			offset += s.data.buf.length();
+		}
+
+		/* Offsets are 32 bit */
+		if (offset + pool.buf.length() > 0xFFFFFFFFUL)
+			return false;
+
+		header.buf.append(magic, magic_len);
+		header.Fixed(version);
+		header.Fixed(offset);
+		header.Fixed(offset + pool.buf.length());
+
+		std::fstream fs(name.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+		if (!fs.is_open())
+			return false;
+
+		fs.write(header.buf.data(), header.buf.length());
+		for (unsigned i = 0; i < sections.size(); ++i)
+			fs.write(sections[i].data.buf.data(), sections[i].data.buf.length());
+		fs.write(pool.buf.data(), pool.buf.length());
+		fs.write(table.buf.data(), table.buf.length());
+
+		fs.close();
+		return !fs.fail();
+	}
+};
+
+class SaveData : public Serialize::Data
+{
+	struct Field
+	{
+		unsigned key;
+		Type type;
+		std::stringstream *value;
+	};
+
+	/* Streams for the values, reused for each object */
+	std::vector<std::stringstream *> streams;
+	/* The fields of the object being saved */
+	std::vector<Field> fields;
+	/* The key given to the last call to SetType, and its type */
+	Anope::string type_key;
+	Type type;
+	Encoder object;
+
+ public:
+	OutputDatabase *db;
+
+	SaveData() : type(DT_TEXT), db(NULL) { }
+
+	~SaveData()
+	{
+		for (unsigned i = 0; i < streams.size(); ++i)
+			delete streams[i];
+	}
+
+	std::iostream& operator[](const Anope::string &key) anope_override
+	{
+		if (fields.size() == streams.size())
+			streams.push_back(new std::stringstream());
+
+		Field f;
+		f.key = db->GetString(key);
+		f.type = key == type_key ? type : DT_TEXT;
+		f.value = streams[fields.size()];
+		f.value->str("");
+		f.value->clear();
+		fields.push_back(f);
+
+		type_key.clear();
+		return *f.value;
+	}
+
+	void SetType(const Anope::string &key, Type t) anope_override
+	{
+		type_key = key;
+		type = t;
+	}
+
+	/** Serializes an object into its section
+	 * @param base The object
+	 */
+	void Save(Serializable *base)
+	{
+		fields.clear();
+		type_key.clear();
+		base->Serialize(*this);
+
+		object.buf.clear();
+		object.Number(fields.size());
+		for (unsigned i = 0; i < fields.size(); ++i)
+		{
+			const Field &f = fields[i];
+			const std::string &value = f.value->str();
+			long v;
+
+			object.Number(f.key);
+			if (f.type == DT_INT && ParseInt(value, v))
+			{
+				object.Byte(DT_INT);
+				object.Signed(v);
+			}
+			else
+			{
+				object.Byte(DT_TEXT);
+				object.Text(value.data(), value.length());
+			}
+		}
+
+		OutputDatabase::Section &s = db->GetSection(base->GetSerializableType());
+		s.data.Text(object.buf.data(), object.buf.length());
+		++s.count;
+	}
+};
+
+/* A database read into memory, mapped if possible */
+class InputDatabase
+{
+	struct String
+	{
+		const char *str;
+		unsigned long len;
+	};
+
+	struct Section
+	{
+		unsigned long count;
+		const char *begin, *end;
+	};
+
+	char *data;
+	size_t length;
+	bool mapped;
+	std::vector<String> strings;
+	std::map<Anope::string, Section> sections;
+
+	bool Parse()
+	{
+		const char *begin = data, *end = data + length;
+		Decoder header(begin, end);
+		const char *m;
+		uint32_t ver, pool_offset, table_offset;
+
+		if (!header.Bytes(magic_len, m) || memcmp(m, magic, magic_len) || !header.Fixed(ver) || ver != version || !header.Fixed(pool_offset) || !header.Fixed(table_offset) || pool_offset > length || table_offset > length)
+			return false;
+
+		Decoder pool(begin + pool_offset, end);
+		uint32_t count;
+		/* Every string takes at least a byte, so a larger count is corrupt, and is not allocated */
+		if (!pool.Fixed(count) || count > pool.Remaining())
+			return false;
+		strings.resize(count);
+		for (unsigned i = 0; i < count; ++i)
+			if (!pool.Number(strings[i].len) || !pool.Bytes(strings[i].len, strings[i].str))
+				return false;
+
+		Decoder table(begin + table_offset, end);
+		if (!table.Fixed(count))
+			return false;
+		for (unsigned i = 0; i < count; ++i)
+		{
+			uint32_t name, objects, offset, len;
+			if (!table.Fixed(name) || !table.Fixed(objects) || !table.Fixed(offset) || !table.Fixed(len) || name >= strings.size() || offset > length || len > length - offset)
+				return false;
+
+			Section &s = sections[Anope::string(strings[name].str, strings[name].len)];
+			s.count = objects;
+			s.begin = begin + offset;
+			s.end = s.begin + len;
+		}
+
+		return true;
+	}
+
+ public:
+	InputDatabase() : data(NULL), length(0), mapped(false) { }
+
+	~InputDatabase()
+	{
+#ifndef _WIN32
+		if (mapped)
+			munmap(data, length);
+		else
+#endif
+			delete [] data;
+	}
+
+	/** Opens and reads a database
+	 * @param name The name of the file
+	 * @return false if the file could not be read, or is not a valid database
+	 */
+	bool Open(const Anope::string &name)
+	{
+#ifdef _WIN32
+		/* read() is a socket function on Windows, and would open the file in text mode */
+		std::ifstream fs(name.c_str(), std::ios_base::in | std::ios_base::binary);
+		if (!fs.is_open())
+			return false;
+
+		fs.seekg(0, std::ios_base::end);
+		length = fs.tellg();
+		fs.seekg(0, std::ios_base::beg);
+
+		data = new char[length];
+		if (length && !fs.read(data, length))
+			return false;
+
+		return this->Parse();
+#else
+		int fd = open(name.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) < 0)
+		{
+			close(fd);
+			return false;
+		}
+		length = st.st_size;
+
+		void *m = length ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		if (m != MAP_FAILED)
+		{
+			data = static_cast<char *>(m);
+			mapped = true;
+			madvise(m, length, MADV_WILLNEED);
+			close(fd);
+			return this->Parse();
+		}
+
+		data = new char[length];
+		for (size_t got = 0; got < length;)
+		{
+			int i = read(fd, data + got, length - got);
+			if (i <= 0)
+			{
+				close(fd);
+				return false;
+			}
+			got += i;
+		}
+
+		close(fd);
+		return this->Parse();
+#endif
+	}
+
+	bool GetString(unsigned long i, const char *&str, unsigned long &len) const
+	{
+		if (i >= strings.size())
+			return false;
+		str = strings[i].str;
+		len = strings[i].len;
+		return true;
+	}
+
+	/** Finds the objects of a type
+	 * @param name The name of the type
+	 * @param count Set to the number of objects
+	 * @return A decoder for the objects, or NULL if there are none
+	 */
+	Decoder *GetSection(const Anope::string &name, unsigned long &count) const
+	{
+		std::map<Anope::string, Section>::const_iterator it = sections.find(name);
+		if (it == sections.end())
+			return NULL;
+		count = it->second.count;
+		return new Decoder(it->second.begin, it->second.end);
+	}
+};
+
+/* A stream buffer reading directly from part of the database */
+class FieldBuffer : public std::streambuf
+{
+ public:
+	void Set(const char *begin, const char *end)
+	{
+		this->setg(const_cast<char *>(begin), const_cast<char *>(begin), const_cast<char *>(end));
+	}
+};
+
+class LoadData : public Serialize::Data
+{
+	struct Field
+	{
+		const char *key, *value;
+		unsigned long key_len, value_len;
+		Type type;
+		long int_value;
+	};
+
+	const InputDatabase &db;
+	/* The fields of the object being loaded */
+	std::vector<Field> fields;
+	FieldBuffer buffer;
+	std::iostream stream;
+	/* Integer values are written here to be read */
+	char int_buffer[sizeof(long) * 3 + 2];
+
+	const Field *Find(const Anope::string &key) const
+	{
+		/* Search backwards so a key given twice has the last value, like db_flatfile */
+		for (unsigned i = fields.size(); i > 0; --i)
+		{
+			const Field &f = fields[i - 1];
+			if (f.key_len == key.length() && !memcmp(f.key, key.c_str(), f.key_len))
+				return &f;
+		}
+		return NULL;
+	}
+
+ public:
+	LoadData(const InputDatabase &d) : db(d), stream(&buffer) { }
+
+	/** Decodes an object
+	 * @param object The object
+	 * @return false if the object is corrupt
+	 */
+	bool Load(Decoder &object)
+	{
+		unsigned long len, count;
+		const char *p;
+		if (!object.Number(len) || !object.Bytes(len, p))
+			return false;
+
+		Decoder d(p, p + len);
+		if (!d.Number(count))
+			return false;
+
+		fields.clear();
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			Field f;
+			unsigned long key;
+			unsigned char type;
+
+			if (!d.Number(key) || !db.GetString(key, f.key, f.key_len) || !d.Byte(type))
+				return false;
+
+			if (type == DT_INT)
+			{
+				f.type = DT_INT;
+				f.value = NULL;
+				f.value_len = 0;
+				if (!d.Signed(f.int_value))
+					return false;
+			}
+			else
+			{
+				f.type = DT_TEXT;
+				f.int_value = 0;
+				if (!d.Number(f.value_len) || !d.Bytes(f.value_len, f.value))
+					return false;
+			}
+
+			fields.push_back(f);
+		}
+
+		return d.AtEnd();
+	}
+
+	std::iostream& operator[](const Anope::string &key) anope_override
+	{
+		const Field *f = this->Find(key);
+
+		if (f == NULL)
+			buffer.Set(NULL, NULL);
+		else if (f->type == DT_INT)
+		{
+			char *end = int_buffer + sizeof(int_buffer);
+			buffer.Set(FormatInt(f->int_value, end), end);
+		}
+		else
+			buffer.Set(f->value, f->value + f->value_len);
+
+		stream.clear();
+		return stream;
+	}
+
+	Type GetType(const Anope::string &key) const anope_override
+	{
+		const Field *f = this->Find(key);
+		return f ? f->type : DT_TEXT;
+	}
+};
+
+/** Gets the time in milliseconds, for timing how long loading takes
+ */
+static long GetTimeMS()
+{
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+class DBBinary : public Module, public Pipe
+{
+	Anope::string database_file;
+	/* Day the last backup was on */
+	int last_day;
+	/* Backup file names */
+	std::map<Anope::string, std::list<Anope::string> > backups;
+	bool use_fork;
+	bool loaded;
+
+	Anope::string GetDatabaseName(Module *owner) const
+	{
+		if (owner)
+			return "module_" + owner->name + ".bin";
+		return database_file;
+	}
+
+	void BackupDatabase()
+	{
+		tm *tm = localtime(&Anope::CurTime);
+
+		if (tm->tm_mday != last_day)
+		{
+			last_day = tm->tm_mday;
+
+			const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
+
+			std::set<Anope::string> dbs;
+			dbs.insert(database_file);
+
+			for (unsigned i = 0; i < type_order.size(); ++i)
+			{
+				Serialize::Type *stype = Serialize::Type::Find(type_order[i]);
+
+				if (stype && stype->GetOwner())
+					dbs.insert(this->GetDatabaseName(stype->GetOwner()));
+			}
+
+
+			for (std::set<Anope::string>::const_iterator it = dbs.begin(), it_end = dbs.end(); it != it_end; ++it)
+			{
+				const Anope::string &oldname = Anope::DataDir + "/" + *it;
+				Anope::string newname = Anope::DataDir + "/backups/" + *it + "." + stringify(tm->tm_year) + "." + stringify(tm->tm_mon) + "." + stringify(tm->tm_mday);
+
+				/* Backup already exists, or there is nothing to back up yet */
+				if (Anope::IsFile(newname) || !Anope::IsFile(oldname))
+					continue;
+
+				Log(LOG_DEBUG) << "db_binary: Attemping to rename " << *it << " to " << newname;
+				if (rename(oldname.c_str(), newname.c_str()))
+				{
+					Log(this) << "Unable to back up database " << *it << "!";
+
+					if (!Config->NoBackupOkay)
+						Anope::Quitting = true;
+
+					continue;
+				}
+
+				backups[*it].push_back(newname);
+
+				if (Config->KeepBackups > 0 && backups[*it].size() > static_cast<unsigned>(Config->KeepBackups))
+				{
+					unlink(backups[*it].front().c_str());
+					backups[*it].pop_front();
+				}
+			}
+		}
+	}
+
+	/** Loads the objects of one type
+	 * @param db The database
+	 * @param stype The type
+	 * @return The number of objects loaded
+	 */
+	unsigned long LoadType(const InputDatabase &db, Serialize::Type *stype)
+	{
+		unsigned long count = 0, i;
+		Decoder *objects = db.GetSection(stype->GetName(), count);
+		if (objects == NULL)
+			return 0;
+
+		LoadData ld(db);
+		for (i = 0; i < count; ++i)
+		{
+			if (!ld.Load(*objects))
+			{
+				Log(this) << "Object " << i << " of type " << stype->GetName() << " is corrupt, not loading the rest of the type";
+				break;
+			}
+
+			stype->Unserialize(NULL, ld);
+		}
+
+		delete objects;
+		return i;
+	}
+
+ public:
+	DBBinary(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE), last_day(0), use_fork(false), loaded(false)
+	{
+		this->SetAuthor("Anope");
+
+		Implementation i[] = { I_OnReload, I_OnLoadDatabase, I_OnSaveDatabase, I_OnSerializeTypeCreate };
+		ModuleManager::Attach(i, this, sizeof(i) / sizeof(Implementation));
+
+		OnReload();
+	}
+
+	void OnNotify() anope_override
+	{
+		char buf[512];
+		int i = this->Read(buf, sizeof(buf) - 1);
+		if (i <= 0)
+			return;
+		buf[i] = 0;
+
+		if (!*buf)
+		{
+			Log(this) << "Finished saving databases";
+			return;
+		}
+
+		Log(this) << "Error saving databases: " << buf;
+
+		if (!Config->NoBackupOkay)
+			Anope::Quitting = true;
+	}
+
+	void OnReload() anope_override
+	{
+		ConfigReader config;
+		database_file = config.ReadValue("db_binary", "database", "anope.bin", 0);
+		use_fork = config.ReadFlag("db_binary", "fork", "no", 0);
+	}
+
+	EventReturn OnLoadDatabase() anope_override
+	{
+		const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
+
+		const Anope::string &db_name = Anope::DataDir + "/" + database_file;
+
+		loaded = true;
+
+		/* Let the next database module load instead, which is how databases are converted to this format */
+		if (!Anope::IsFile(db_name))
+		{
+			Log(this) << db_name << " does not exist, not loading it";
+			return EVENT_CONTINUE;
+		}
+
+		long start = GetTimeMS();
+
+		InputDatabase db;
+		if (!db.Open(db_name))
+		{
+			Log(this) << "Unable to read " << db_name << ", it is either not a valid database or is corrupt!";
+			return EVENT_STOP;
+		}
+
+		for (unsigned i = 0; i < type_order.size(); ++i)
+		{
+			Serialize::Type *stype = Serialize::Type::Find(type_order[i]);
+			if (!stype || stype->GetOwner())
+				continue;
+
+			long type_start = GetTimeMS();
+			unsigned long count = this->LoadType(db, stype);
+
+			if (count)
+				Log(this) << "Loaded " << count << " " << stype->GetName() << " in " << (GetTimeMS() - type_start) << "ms";
+		}
+
+		Log(this) << "Loaded " << db_name << " in " << (GetTimeMS() - start) << "ms";
+
+		return EVENT_STOP;
+	}
+
+	EventReturn OnSaveDatabase() anope_override
+	{
+		BackupDatabase();
+
+		int i = -1;
+		if (use_fork)
+		{
+			i = fork();
+			if (i > 0)
+				return EVENT_CONTINUE;
+			else if (i < 0)
+				Log(this) << "Unable to fork for database save";
+		}
+
+		try
+		{
+			std::map<Module *, OutputDatabase> databases;
+
+			SaveData data;
+			const std::list<Serializable *> &items = Serializable::GetItems();
+			for (std::list<Serializable *>::const_iterator it = items.begin(), it_end = items.end(); it != it_end; ++it)
+			{
+				Serializable *base = *it;
+				Serialize::Type *s_type = base->GetSerializableType();
+
+				if (!s_type)
+					continue;
+
+				data.db = &databases[s_type->GetOwner()];
+				data.Save(base);
+			}
+
+			Anope::string errors;
+			for (std::map<Module *, OutputDatabase>::iterator it = databases.begin(), it_end = databases.end(); it != it_end; ++it)
+			{
+				const Anope::string &db_name = Anope::DataDir + "/" + this->GetDatabaseName(it->first);
+
+				/* Write to a temporary file first so the old database is left alone if this fails */
+				if (!it->second.Write(db_name + ".tmp") || !Anope::ReplaceFile(db_name + ".tmp", db_name))
+				{
+					unlink((db_name + ".tmp").c_str());
+					errors += (errors.empty() ? "" : ", ") + db_name;
+				}
+			}
+
+			/* Errors are handled in OnNotify whether or not this is a child process */
+			if (!errors.empty())
+				this->Write("Unable to write database " + errors);
+			else if (!i)
+				this->Notify();
+		}
+		catch (...)
+		{
+			if (i)
+				throw;
+		}
+
+		if (!i)
+			exit(0);
+
+		return EVENT_CONTINUE;
+	}
+
+	/* Load just one type. Done if a module is reloaded during runtime */
+	void OnSerializeTypeCreate(Serialize::Type *stype) anope_override
+	{
+		if (!loaded)
+			return;
+
+		const Anope::string &db_name = Anope::DataDir + "/" + this->GetDatabaseName(stype->GetOwner());
+		if (!Anope::IsFile(db_name))
+			return;
+
+		InputDatabase db;
+		if (!db.Open(db_name))
+		{
+			Log(this) << "Unable to read " << db_name << ", it is either not a valid database or is corrupt!";
+			return;
+		}
+
+		this->LoadType(db, stype);
+	}
+};
+
+MODULE_INIT(DBBinary)
@@ -12,10 +12,17 @@
 
 #include "module.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/time.h>
+#endif
+
 class SaveData : public Serialize::Data
 {
  public:
-	std::fstream *fs;
+	std::iostream *fs;
 
 	SaveData() : fs(NULL) { }
 
@@ -26,45 +33,497 @@ class SaveData : public Serialize::Data
 	}
 };
 
+/* A database file read into memory, mapped if possible */
+class DatabaseFile
+{
+	char *data;
+	size_t length;
+	bool mapped;
+
+ public:
+	DatabaseFile() : data(NULL), length(0), mapped(false) { }
+
+	~DatabaseFile()
+	{
+#ifndef _WIN32
+		if (mapped)
+			munmap(data, length);
+		else
+#endif
+			delete [] data;
+	}
+
+	/** Opens and reads a database
+	 * @param name The name of the file
+	 * @return false if the file could not be read
+	 */
+	bool Open(const Anope::string &name)
+	{
+#ifdef _WIN32
+		/* read() is a socket function on Windows, so the file is read with a binary stream instead */
+		std::ifstream fs(name.c_str(), std::ios_base::in | std::ios_base::binary);
+		if (!fs.is_open())
+			return false;
+
+		fs.seekg(0, std::ios_base::end);
+		length = fs.tellg();
+		fs.seekg(0, std::ios_base::beg);
+
+		data = new char[length];
+		if (length && !fs.read(data, length))
+			return false;
+
+		/* Databases written by a text mode stream end their lines with \r\n */
+		char *out = data;
+		for (size_t i = 0; i < length; ++i)
+			if (data[i] != '\r' || i + 1 == length || data[i + 1] != '\n')
+				*out++ = data[i];
+		length = out - data;
+
+		return true;
+#else
+		int fd = open(name.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) < 0)
+		{
+			close(fd);
+			return false;
+		}
+		length = st.st_size;
+
+		if (length == 0)
+		{
+			close(fd);
+			return true;
+		}
+
+		void *m = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m != MAP_FAILED)
+		{
+			data = static_cast<char *>(m);
+			mapped = true;
+			/* It is read from start to end once, then again an object at a time */
+			madvise(m, length, MADV_SEQUENTIAL);
+			close(fd);
+			return true;
+		}
+
+		data = new char[length];
+		for (size_t got = 0; got < length;)
+		{
+			int i = read(fd, data + got, length - got);
+			if (i <= 0)
+			{
+				close(fd);
+				return false;
+			}
+			got += i;
+		}
+
+		close(fd);
+		return true;
+#endif
+	}
+
+	const char *Begin() const { return data; }
+	const char *End() const { return data + length; }
+};
+
+/** Finds the end of a line
+ * @param p The start of the line
+ * @param end The end of the file
+ * @return The position of the newline, or end
+ */
+static inline const char *LineEnd(const char *p, const char *end)
+{
+	const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+	return nl ? nl : end;
+}
+
+/** Finds where each object in a database starts
+ * @param db The database
+ * @param positions Filled in with the start of the data of each object, by type
+ */
+static void FindObjects(const DatabaseFile &db, std::map<Anope::string, std::vector<const char *> > &positions)
+{
+	static const char object[] = "OBJECT ";
+	static const size_t object_len = sizeof(object) - 1;
+
+	/* Objects of the same type are usually together, so avoid looking up the type for each one */
+	const char *last_type = NULL;
+	size_t last_type_len = 0;
+	std::vector<const char *> *last_positions = NULL;
+
+	for (const char *p = db.Begin(), *end = db.End(); p < end;)
+	{
+		const char *line_end = LineEnd(p, end), *next = line_end == end ? end : line_end + 1;
+
+		if (static_cast<size_t>(line_end - p) >= object_len && !memcmp(p, object, object_len))
+		{
+			const char *type = p + object_len;
+			size_t type_len = line_end - type;
+
+			if (last_positions == NULL || type_len != last_type_len || memcmp(type, last_type, type_len))
+			{
+				last_positions = &positions[Anope::string(type, type_len)];
+				last_type = type;
+				last_type_len = type_len;
+			}
+
+			last_positions->push_back(next);
+		}
+
+		p = next;
+	}
+}
+
+/* A stream buffer reading directly from part of the database */
+class FieldBuffer : public std::streambuf
+{
+ public:
+	void Set(const char *begin, const char *end)
+	{
+		this->setg(const_cast<char *>(begin), const_cast<char *>(begin), const_cast<char *>(end));
+	}
+};
+
+/* A DATA line of an object */
+struct Field
+{
+	const char *key, *value;
+	size_t key_len, value_len;
+};
+
+/** Reads the DATA lines of an object, and its ID line if it has one
+ * @param p The start of the object's data
+ * @param end The end of the database
+ * @param fields The object's fields are appended to this
+ * @return The object's id, or 0 if it has none
+ */
+static unsigned int ParseObject(const char *p, const char *end, std::vector<Field> &fields)
+{
+	static const char data[] = "DATA ", id_line[] = "ID ";
+	static const size_t data_len = sizeof(data) - 1, id_len = sizeof(id_line) - 1;
+
+	while (p < end)
+	{
+		const char *line_end = LineEnd(p, end);
+
+		if (static_cast<size_t>(line_end - p) < data_len || memcmp(p, data, data_len))
+			break;
+
+		const char *key = p + data_len, *sp = static_cast<const char *>(memchr(key, ' ', line_end - key));
+		if (sp != NULL)
+		{
+			Field f;
+			f.key = key;
+			f.key_len = sp - key;
+			f.value = sp + 1;
+			f.value_len = line_end - f.value;
+			fields.push_back(f);
+		}
+
+		p = line_end == end ? end : line_end + 1;
+	}
+
+	unsigned int id = 0;
+	if (static_cast<size_t>(end - p) > id_len && !memcmp(p, id_line, id_len))
+		for (p += id_len; p < end && *p >= '0' && *p <= '9'; ++p)
+			id = id * 10 + (*p - '0');
+	return id;
+}
+
 class LoadData : public Serialize::Data
 {
+	const char *end;
+	/* The fields of the object being loaded, if it was read with Load() */
+	std::vector<Field> own_fields;
+	/* The fields of the object being loaded */
+	const Field *fields;
+	size_t num_fields;
+	/* The object's id, if the database has them */
+	unsigned int id;
+	FieldBuffer buffer;
+	std::iostream stream;
+
  public:
- 	std::fstream *fs;
-	std::map<Anope::string, Anope::string> data;
-	std::stringstream ss;
-	bool read;
+	LoadData(const DatabaseFile &db) : end(db.End()), fields(NULL), num_fields(0), id(0), stream(&buffer) { }
 
-	LoadData() : fs(NULL), read(false) { }
+	/** Reads the DATA lines of an object, and its ID line if it has one
+	 * @param p The start of the object's data
+	 */
+	void Load(const char *p)
+	{
+		own_fields.clear();
+		id = ParseObject(p, end, own_fields);
+		this->Set(own_fields.empty() ? NULL : &own_fields[0], own_fields.size(), id);
+	}
+
+	/** Uses fields which have already been read
+	 * @param f The first field
+	 * @param count The number of fields
+	 * @param i The object's id
+	 */
+	void Set(const Field *f, size_t count, unsigned int i)
+	{
+		fields = f;
+		num_fields = count;
+		id = i;
+	}
+
+	unsigned int GetID() const { return id; }
 
 	std::iostream& operator[](const Anope::string &key) anope_override
 	{
-		if (!read)
+		const char *value = NULL;
+		size_t value_len = 0;
+
+		/* Search backwards so a key given twice has the last value, like it always has */
+		for (size_t i = num_fields; i > 0; --i)
 		{
-			for (Anope::string token; std::getline(*this->fs, token.str());)
+			const Field &f = fields[i - 1];
+			if (f.key_len == key.length() && !memcmp(f.key, key.c_str(), f.key_len))
 			{
-				if (token.find("DATA ") != 0)
-					break;
-
-				size_t sp = token.find(' ', 5); // Skip DATA
-				if (sp != Anope::string::npos)
-					data[token.substr(5, sp - 5)] = token.substr(sp + 1);
+				value = f.value;
+				value_len = f.value_len;
+				break;
 			}
+		}
+
+		buffer.Set(value, value + value_len);
+		stream.clear();
+		return stream;
+	}
+};
 
-			read = true;
+/* A run of objects of one type, which are read by a ParseThread and then loaded by the main thread */
+struct ParseChunk
+{
+	Serialize::Type *stype;
+	/* Where each object starts */
+	const char * const *begin, * const *end;
+	/* The fields of every object in the chunk, one after the other */
+	std::vector<Field> fields;
+	/* Where each object's fields start in fields, and its id */
+	std::vector<std::pair<size_t, unsigned int> > objects;
+	/* Set once the chunk has been read */
+	bool done;
+
+	ParseChunk(Serialize::Type *t, const char * const *b, const char * const *e) : stype(t), begin(b), end(e), done(false) { }
+
+	void Parse(const char *db_end)
+	{
+		objects.reserve(end - begin);
+		for (const char * const *p = begin; p != end; ++p)
+		{
+			size_t first = fields.size();
+			objects.push_back(std::make_pair(first, ParseObject(*p, db_end, fields)));
 		}
+	}
+};
 
-		ss.clear();
-		this->ss << this->data[key];
-		return this->ss;
+/* Chunks waiting to be read, shared between the main thread and the ParseThreads */
+class ParseQueue : public Condition
+{
+	/* The next chunk nothing has started reading */
+	size_t next;
+	/* The next chunk the main thread will load */
+	size_t loading;
+	/* How far ahead of the main thread chunks are read, so the whole database isn't held in memory twice */
+	static const size_t window = 64;
+
+ public:
+	const char *db_end;
+	std::deque<ParseChunk> chunks;
+
+	ParseQueue(const char *e) : next(0), loading(0), db_end(e) { }
+
+	/** Reads chunks until there are none left to start
+	 */
+	void Work()
+	{
+		for (;;)
+		{
+			this->Lock();
+			while (next < chunks.size() && next >= loading + window)
+				this->Wait();
+			size_t i = next;
+			if (i < chunks.size())
+				++next;
+			this->Unlock();
+
+			if (i >= chunks.size())
+				return;
+
+			chunks[i].Parse(db_end);
+
+			this->Lock();
+			chunks[i].done = true;
+			this->WakeupAll();
+			this->Unlock();
+		}
 	}
-	
-	void Reset()
+
+	/** Waits until a chunk has been read. If nothing has started reading it yet, it is read by the calling thread.
+	 * @param i The chunk, which must be the one after the last chunk given by this
+	 * @return The chunk
+	 */
+	ParseChunk &Get(size_t i)
 	{
-		read = false;
-		data.clear();
+		this->Lock();
+		loading = i;
+		/* Let the threads read further ahead */
+		this->WakeupAll();
+
+		if (next == i)
+		{
+			++next;
+			this->Unlock();
+
+			chunks[i].Parse(db_end);
+			return chunks[i];
+		}
+
+		while (!chunks[i].done)
+			this->Wait();
+		this->Unlock();
+
+		return chunks[i];
 	}
 };
 
+/* Reads objects from a database while the main thread loads the ones already read */
+class ParseThread : public Thread
+{
+	ParseQueue &queue;
+
+ public:
+	ParseThread(ParseQueue &q) : Thread(), queue(q) { }
+
+	void Run() anope_override
+	{
+		queue.Work();
+	}
+};
+
+/** Gets the time in milliseconds, for timing how long loading takes
+ */
+static long GetTimeMS()
+{
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/** Reads an id from a database
+ * @param p The start of the id
+ * @param end The end of the database
+ * @return The id
+ */
+static unsigned int ParseID(const char *p, const char *end)
+{
+	unsigned int id = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p)
+		id = id * 10 + (*p - '0');
+	return id;
+}
+
+/** Writes a file and flushes it to disk
+ * @param name The name of the file
+ * @param contents What to write
+ * @return false on error
+ */
+static bool WriteFile(const Anope::string &name, const std::string &contents)
+{
+#ifdef _WIN32
+	/* write() is a socket function on Windows, and there is no fsync */
+	std::ofstream fs(name.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+	if (!fs.is_open())
+		return false;
+
+	fs.write(contents.data(), contents.length());
+	fs.close();
+	return !fs.fail();
+#else
+	int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return false;
+
+	for (size_t written = 0; written < contents.length();)
+	{
+		int i = write(fd, contents.data() + written, contents.length() - written);
+		if (i <= 0)
+		{
+			close(fd);
+			return false;
+		}
+		written += i;
+	}
+
+	if (fsync(fd))
+	{
+		close(fd);
+		return false;
+	}
+
+	return !close(fd);
+#endif
+}
+
+class DBFlatFile;
+
+/* Writes databases which have been serialized into memory */
+class SaveThread : public Thread
+{
+	DBFlatFile *module;
+	bool journal;
+
+ public:
+	/* The databases to write, by file name */
+	std::vector<std::pair<Anope::string, std::stringstream *> > databases;
+	/* The databases which could not be written, if any */
+	Anope::string errors;
+	/* How long writing took */
+	long write_time;
+
+	SaveThread(DBFlatFile *m, bool j) : Thread(), module(m), journal(j), write_time(0) { }
+
+	~SaveThread()
+	{
+		for (unsigned i = 0; i < databases.size(); ++i)
+			delete databases[i].second;
+	}
+
+	void Run() anope_override
+	{
+		long start = GetTimeMS();
+
+		for (unsigned i = 0; i < databases.size(); ++i)
+		{
+			const Anope::string &db_name = databases[i].first;
+
+			/* Write to a temporary file first so the old database is left alone if this fails */
+			if (!WriteFile(db_name + ".tmp", databases[i].second->str()) || !Anope::ReplaceFile(db_name + ".tmp", db_name))
+			{
+				unlink((db_name + ".tmp").c_str());
+				errors += (errors.empty() ? "" : ", ") + db_name;
+				continue;
+			}
+
+			/* Everything in the journal is in the database now */
+			if (journal)
+				unlink((db_name + ".journal").c_str());
+		}
+
+		write_time = GetTimeMS() - start;
+	}
+
+	void OnNotify() anope_override;
+};
+
 class DBFlatFile : public Module, public Pipe
 {
 	Anope::string database_file;
@@ -73,7 +532,39 @@ class DBFlatFile : public Module, public Pipe
 	/* Backup file names */
 	std::map<Anope::string, std::list<Anope::string> > backups;
 	bool use_fork;
+	/* How many threads to read databases with when starting */
+	unsigned load_threads;
+	/* Whether to write databases with a SaveThread */
+	bool use_thread;
+	/* The thread writing the databases, if it is still running */
+	SaveThread *save_thread;
+	/* How long the main loop was blocked by the last save */
+	long stall_time;
 	bool loaded;
+	/* Whether only changes are written to a journal, with full saves only when compacting it */
+	bool use_journal;
+	/* How large the journal can get, as a percentage of the database's size, before it is compacted */
+	unsigned compact_percent;
+	/* Set while loading, so loaded objects are not written back to the journal */
+	bool loading;
+	/* Set when the next save must be a full save, because objects without ids were loaded (which can't be journaled
+	 * until a full save gives them ids), or the last full save failed
+	 */
+	bool full_save;
+	/* Objects changed since the journal was last written */
+	std::map<Serializable *, Reference<Serializable> > updated_items;
+	/* Objects deleted since the journal was last written, as journal lines, by database */
+	std::map<Module *, Anope::string> deleted_items;
+	unsigned deleted_count;
+	/* Modules being unloaded. Their objects are only being removed from memory, not deleted */
+	std::set<Module *> unloading;
+
+	Anope::string GetDatabaseName(Module *owner) const
+	{
+		if (owner)
+			return Anope::DataDir + "/module_" + owner->name + ".db";
+		return Anope::DataDir + "/" + database_file;
+	}
 
 	void BackupDatabase()
 	{
@@ -128,17 +619,377 @@ class DBFlatFile : public Module, public Pipe
 		}
 	}
 
+	std::iostream *OpenDatabase(std::map<Module *, std::iostream *> &databases, Module *owner, bool in_memory)
+	{
+		std::iostream *&fs = databases[owner];
+
+		if (!fs && in_memory)
+			fs = new std::stringstream();
+		else if (!fs)
+		{
+			const Anope::string &db_name = this->GetDatabaseName(owner);
+
+			if (Anope::IsFile(db_name))
+				rename(db_name.c_str(), (db_name + ".tmp").c_str());
+
+			std::fstream *f = new std::fstream(db_name.c_str(), std::ios_base::out | std::ios_base::trunc);
+			fs = f;
+
+			if (!f->is_open())
+				Log(this) << "Unable to open " << db_name << " for writing";
+		}
+
+		return fs;
+	}
+
+	/** Serializes every object into the database it belongs in
+	 * @param databases Filled in with the databases, by the module owning them
+	 * @param in_memory true to serialize into memory, false to write the database files
+	 */
+	void SerializeDatabases(std::map<Module *, std::iostream *> &databases, bool in_memory)
+	{
+		/* Write every database, even ones with no objects left, so all of their journals can be emptied */
+		if (use_journal)
+		{
+			const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
+
+			this->OpenDatabase(databases, NULL, in_memory);
+			for (unsigned j = 0; j < type_order.size(); ++j)
+			{
+				Serialize::Type *stype = Serialize::Type::Find(type_order[j]);
+				if (stype)
+					this->OpenDatabase(databases, stype->GetOwner(), in_memory);
+			}
+		}
+
+		SaveData data;
+		const std::list<Serializable *> &items = Serializable::GetItems();
+		for (std::list<Serializable *>::const_iterator it = items.begin(), it_end = items.end(); it != it_end; ++it)
+		{
+			Serializable *base = *it;
+			Serialize::Type *s_type = base->GetSerializableType();
+
+			if (!s_type)
+				continue;
+
+			data.fs = this->OpenDatabase(databases, s_type->GetOwner(), in_memory);
+			if (data.fs->fail())
+				continue;
+
+			*data.fs << "OBJECT " << s_type->GetName();
+			base->Serialize(data);
+			if (use_journal)
+			{
+				AssignID(base);
+				*data.fs << "\nID " << base->id;
+			}
+			*data.fs << "\nEND\n";
+		}
+
+		/* Everything journaled so far is in these */
+		if (use_journal)
+		{
+			full_save = false;
+			updated_items.clear();
+			deleted_items.clear();
+			deleted_count = 0;
+			Serializable::NextGeneration();
+		}
+	}
+
+	/** Waits for the databases being written by the save thread, if any
+	 */
+	void WaitForSave()
+	{
+		if (save_thread)
+		{
+			SaveThread *t = save_thread;
+			t->Join();
+			this->OnSaveFinished(t);
+			delete t;
+		}
+	}
+
+	/** Unserializes an object. In journal mode, if an object with its id already exists
+	 * that object is updated instead.
+	 * @param stype The type of the object
+	 * @param ld The object's data
+	 */
+	void LoadObject(Serialize::Type *stype, LoadData &ld)
+	{
+		if (!use_journal)
+		{
+			stype->Unserialize(NULL, ld);
+			return;
+		}
+
+		unsigned int id = ld.GetID();
+		Serializable *obj = NULL;
+
+		if (id)
+		{
+			std::map<unsigned int, Serializable *>::iterator it = stype->objects.find(id);
+			if (it != stype->objects.end())
+				obj = it->second;
+		}
+
+		obj = stype->Unserialize(obj, ld);
+		if (!obj)
+			return;
+
+		if (id)
+		{
+			obj->id = id;
+			stype->objects[id] = obj;
+		}
+		else
+			full_save = true;
+	}
+
+	/** Gives an object an id, if it doesn't have one, so it can be journaled
+	 * @param obj The object
+	 */
+	static void AssignID(Serializable *obj)
+	{
+		if (obj->id)
+			return;
+
+		Serialize::Type *stype = obj->GetSerializableType();
+		obj->id = stype->objects.empty() ? 1 : stype->objects.rbegin()->first + 1;
+		stype->objects[obj->id] = obj;
+	}
+
+	/** Applies the changes written to a database's journal
+	 * @param db_name The database
+	 * @param only If not NULL, only changes to objects of this type are applied
+	 */
+	void ReplayJournal(const Anope::string &db_name, Serialize::Type *only)
+	{
+		static const char object[] = "OBJECT ", del[] = "DELETE ";
+		static const size_t object_len = sizeof(object) - 1, del_len = sizeof(del) - 1;
+
+		const Anope::string &journal_name = db_name + ".journal";
+		if (!Anope::IsFile(journal_name))
+			return;
+
+		long start = GetTimeMS();
+
+		DatabaseFile journal;
+		if (!journal.Open(journal_name))
+		{
+			Log(this) << "Unable to open " << journal_name << " for reading!";
+			return;
+		}
+
+		LoadData ld(journal);
+		unsigned changes = 0;
+
+		for (const char *p = journal.Begin(), *end = journal.End(); p < end;)
+		{
+			const char *line_end = LineEnd(p, end), *next = line_end == end ? end : line_end + 1;
+			size_t len = line_end - p;
+
+			if (len > object_len && !memcmp(p, object, object_len))
+			{
+				Serialize::Type *stype = Serialize::Type::Find(Anope::string(p + object_len, line_end));
+
+				if (stype && (!only || stype == only))
+				{
+					ld.Load(next);
+					this->LoadObject(stype, ld);
+					++changes;
+				}
+			}
+			else if (len > del_len && !memcmp(p, del, del_len))
+			{
+				const char *type_name = p + del_len, *sp = static_cast<const char *>(memchr(type_name, ' ', line_end - type_name));
+				Serialize::Type *stype = sp ? Serialize::Type::Find(Anope::string(type_name, sp)) : NULL;
+
+				if (stype && (!only || stype == only))
+				{
+					std::map<unsigned int, Serializable *>::iterator it = stype->objects.find(ParseID(sp + 1, line_end));
+					if (it != stype->objects.end())
+					{
+						Serializable *obj = it->second;
+						stype->objects.erase(it);
+						obj->Destroy();
+					}
+					++changes;
+				}
+			}
+
+			p = next;
+		}
+
+		Log(this) << "Applied " << changes << " changes from " << journal_name << " in " << (GetTimeMS() - start) << "ms";
+	}
+
+	std::fstream *OpenJournal(std::map<Module *, std::fstream *> &journals, Module *owner)
+	{
+		std::fstream *&fs = journals[owner];
+
+		if (!fs)
+		{
+			const Anope::string &journal_name = this->GetDatabaseName(owner) + ".journal";
+
+			fs = new std::fstream(journal_name.c_str(), std::ios_base::out | std::ios_base::app);
+
+			if (!fs->is_open())
+				Log(this) << "Unable to open " << journal_name << " for writing";
+		}
+
+		return fs;
+	}
+
+	/** Appends the objects changed and deleted since the last time to the journals
+	 */
+	void WriteJournal()
+	{
+		if (updated_items.empty() && deleted_items.empty())
+			return;
+
+		/* A full save being written would remove the journal afterwards */
+		this->WaitForSave();
+
+		long start = GetTimeMS();
+		std::map<Module *, std::fstream *> journals;
+		unsigned updated = 0;
+
+		/* Deletions are first, as a deleted object's id may have been reused */
+		for (std::map<Module *, Anope::string>::iterator it = deleted_items.begin(), it_end = deleted_items.end(); it != it_end; ++it)
+		{
+			std::fstream *fs = this->OpenJournal(journals, it->first);
+			if (fs->is_open())
+				*fs << it->second;
+		}
+
+		/* The journal is replayed in order, so objects are written in type order, as they are loaded from the database,
+		 * so an object is never replayed before an object it refers to, such as a NickAlias before its NickCore
+		 */
+		std::map<Serialize::Type *, std::vector<Serializable *> > updated_types;
+		for (std::map<Serializable *, Reference<Serializable> >::iterator it = updated_items.begin(), it_end = updated_items.end(); it != it_end; ++it)
+		{
+			Reference<Serializable> &obj = it->second;
+			if (!obj)
+				continue;
+
+			Serialize::Type *s_type = obj->GetSerializableType();
+			if (s_type)
+				updated_types[s_type].push_back(obj);
+		}
+
+		SaveData data;
+		const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
+		for (unsigned i = 0; i < type_order.size(); ++i)
+		{
+			Serialize::Type *s_type = Serialize::Type::Find(type_order[i]);
+			std::map<Serialize::Type *, std::vector<Serializable *> >::iterator it = updated_types.find(s_type);
+			if (it == updated_types.end())
+				continue;
+
+			std::fstream *fs = this->OpenJournal(journals, s_type->GetOwner());
+			if (!fs->is_open())
+				continue;
+			data.fs = fs;
+
+			for (unsigned j = 0; j < it->second.size(); ++j)
+			{
+				Serializable *obj = it->second[j];
+
+				AssignID(obj);
+
+				*data.fs << "OBJECT " << s_type->GetName();
+				obj->Serialize(data);
+				*data.fs << "\nID " << obj->id << "\nEND\n";
+				++updated;
+			}
+		}
+
+		for (std::map<Module *, std::fstream *>::iterator it = journals.begin(), it_end = journals.end(); it != it_end; ++it)
+		{
+			std::fstream *f = it->second;
+
+			if (f->is_open())
+			{
+				f->close();
+				if (f->fail())
+					Log(this) << "Unable to write journal " << this->GetDatabaseName(it->first) << ".journal";
+			}
+
+			delete f;
+		}
+
+		Log(LOG_DEBUG) << "db_flatfile: Journaled " << updated << " changed and " << deleted_count << " deleted objects in " << (GetTimeMS() - start) << "ms";
+
+		updated_items.clear();
+		deleted_items.clear();
+		deleted_count = 0;
+		Serializable::NextGeneration();
+	}
+
+	/** Checks whether the next save should be a full save, after which the journals are emptied
+	 */
+	bool NeedsCompaction() const
+	{
+		if (full_save)
+			return true;
+
+		/* Backups are only made on full saves, so do one every day. This is also always the first save after starting. */
+		if (localtime(&Anope::CurTime)->tm_mday != last_day)
+			return true;
+
+		const Anope::string &db_name = this->GetDatabaseName(NULL);
+		struct stat db_st, journal_st;
+
+		if (stat(db_name.c_str(), &db_st) < 0)
+			return true;
+		if (stat((db_name + ".journal").c_str(), &journal_st) < 0)
+			return false;
+
+		return static_cast<double>(journal_st.st_size) * 100 > static_cast<double>(db_st.st_size) * compact_percent;
+	}
+
  public:
-	DBFlatFile(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE), last_day(0), use_fork(false), loaded(false)
+	DBFlatFile(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE), last_day(0), use_fork(false), load_threads(1), use_thread(false),
+		save_thread(NULL), stall_time(0), loaded(false), use_journal(false),
+		compact_percent(0), loading(false), full_save(false), deleted_count(0)
 	{
 		this->SetAuthor("Anope");
 
-		Implementation i[] = { I_OnReload, I_OnLoadDatabase, I_OnSaveDatabase, I_OnSerializeTypeCreate };
+		Implementation i[] = { I_OnReload, I_OnShutdown, I_OnRestart, I_OnLoadDatabase, I_OnSaveDatabase, I_OnSerializeTypeCreate, I_OnSerializableConstruct,
+			I_OnSerializableDestruct, I_OnSerializableUpdate, I_OnModuleLoad, I_OnModuleUnload };
 		ModuleManager::Attach(i, this, sizeof(i) / sizeof(Implementation));
 
 		OnReload();
 	}
 
+	~DBFlatFile()
+	{
+		this->WaitForSave();
+	}
+
+	/** Called when the save thread has finished
+	 * @param t The thread
+	 */
+	void OnSaveFinished(SaveThread *t)
+	{
+		save_thread = NULL;
+
+		if (!t->errors.empty())
+		{
+			Log(this) << "Error saving databases: Unable to write database " << t->errors;
+
+			/* The journals were emptied into a database that wasn't written */
+			if (use_journal)
+				full_save = true;
+
+			if (!Config->NoBackupOkay)
+				Anope::Quitting = true;
+		}
+		else
+			Log(this) << "Finished saving databases in " << t->write_time << "ms, the main loop was blocked for " << stall_time << "ms";
+	}
+
 	void OnNotify() anope_override
 	{
 		char buf[512];
@@ -164,62 +1015,195 @@ class DBFlatFile : public Module, public Pipe
 		ConfigReader config;
 		database_file = config.ReadValue("db_flatfile", "database", "anope.db", 0);
 		use_fork = config.ReadFlag("db_flatfile", "fork", "no", 0);
+		use_thread = config.ReadFlag("db_flatfile", "thread", "no", 0);
+
+		load_threads = config.ReadInteger("db_flatfile", "loadthreads", "0", 0, false);
+#ifndef _WIN32
+		/* Default to one for each CPU */
+		if (!load_threads)
+		{
+			long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			load_threads = cpus > 0 ? cpus : 1;
+		}
+#endif
+		if (!load_threads)
+			load_threads = 1;
+
+		bool journal = config.ReadFlag("db_flatfile", "journal", "no", 0);
+		/* Objects loaded without journaling have no ids */
+		if (journal && !use_journal && loaded)
+			full_save = true;
+		use_journal = journal;
+
+		compact_percent = config.ReadInteger("db_flatfile", "compact", "50", 0, false);
+		if (!compact_percent)
+			compact_percent = 50;
+	}
+
+	void OnShutdown() anope_override
+	{
+		this->WaitForSave();
+
+		/* Not every change is reported with OnSerializableUpdate, so write everything when shutting down */
+		if (use_journal && loaded)
+		{
+			full_save = true;
+			this->OnSaveDatabase();
+		}
+	}
+
+	void OnRestart() anope_override
+	{
+		this->OnShutdown();
 	}
 
 	EventReturn OnLoadDatabase() anope_override
 	{
 		const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
-		std::set<Anope::string> tried_dbs;
 
 		const Anope::string &db_name = Anope::DataDir + "/" + database_file;
 
-		std::fstream fd(db_name.c_str(), std::ios_base::in);
-		if (!fd.is_open())
+		long start = GetTimeMS();
+
+		DatabaseFile db;
+		if (!db.Open(db_name))
 		{
 			Log(this) << "Unable to open " << db_name << " for reading!";
 			return EVENT_STOP;
 		}
 
-		std::map<Anope::string, std::vector<std::streampos> > positions;
+		std::map<Anope::string, std::vector<const char *> > positions;
+		FindObjects(db, positions);
 
-		for (Anope::string buf; std::getline(fd, buf.str());)
-			if (buf.find("OBJECT ") == 0)
-				positions[buf.substr(7)].push_back(fd.tellg());
-
-		LoadData ld;
-		ld.fs = &fd;
+		Log(this) << "Read " << db_name << " in " << (GetTimeMS() - start) << "ms";
 
+		/* Reading the objects doesn't depend on anything else, so it is split into chunks and done by threads.
+		 * Loading them has to be done here, in type order, but can start as soon as the first chunk has been read.
+		 */
+		ParseQueue queue(db.End());
 		for (unsigned i = 0; i < type_order.size(); ++i)
 		{
 			Serialize::Type *stype = Serialize::Type::Find(type_order[i]);
 			if (!stype || stype->GetOwner())
 				continue;
-				
-			std::vector<std::streampos> &pos = positions[stype->GetName()];
 
-			for (unsigned j = 0; j < pos.size(); ++j)
+			const std::vector<const char *> &pos = positions[stype->GetName()];
+			for (size_t j = 0; j < pos.size(); j += 4096)
+				queue.chunks.push_back(ParseChunk(stype, &pos[j], &pos[0] + std::min(j + 4096, pos.size())));
+		}
+
+		std::vector<ParseThread *> threads;
+		for (unsigned i = 1; i < load_threads && i < queue.chunks.size(); ++i)
+		{
+			ParseThread *t = new ParseThread(queue);
+			try
+			{
+				t->Start();
+				threads.push_back(t);
+			}
+			catch (const CoreException &ex)
+			{
+				/* Whatever the threads don't read is read here instead */
+				Log(this) << "Unable to start thread to read databases: " << ex.GetReason();
+				delete t;
+				break;
+			}
+		}
+
+		LoadData ld(db);
+		loading = true;
+
+		for (size_t i = 0; i < queue.chunks.size();)
+		{
+			Serialize::Type *stype = queue.chunks[i].stype;
+			size_t count = 0;
+			long type_start = GetTimeMS();
+
+			for (; i < queue.chunks.size() && queue.chunks[i].stype == stype; ++i)
 			{
-				fd.clear();
-				fd.seekg(pos[j]);
+				ParseChunk &chunk = queue.Get(i);
+
+				for (size_t j = 0; j < chunk.objects.size(); ++j)
+				{
+					size_t first = chunk.objects[j].first, last = j + 1 < chunk.objects.size() ? chunk.objects[j + 1].first : chunk.fields.size();
+					ld.Set(first < last ? &chunk.fields[first] : NULL, last - first, chunk.objects[j].second);
+					this->LoadObject(stype, ld);
+				}
 
-				stype->Unserialize(NULL, ld);
-				ld.Reset();
+				count += chunk.objects.size();
+				/* Nothing needs it now that it's loaded */
+				std::vector<Field>().swap(chunk.fields);
+				std::vector<std::pair<size_t, unsigned int> >().swap(chunk.objects);
 			}
+
+			Log(this) << "Loaded " << count << " " << stype->GetName() << " in " << (GetTimeMS() - type_start) << "ms";
 		}
 
-		fd.close();
+		for (unsigned i = 0; i < threads.size(); ++i)
+		{
+			threads[i]->Join();
+			delete threads[i];
+		}
+
+		if (use_journal)
+			this->ReplayJournal(db_name, NULL);
+
+		/* Updates queued while loading were ignored, so they have to be passed on again */
+		loading = false;
+		Serializable::NextGeneration();
+
+		Log(this) << "Loaded " << db_name << " in " << (GetTimeMS() - start) << "ms";
 
 		loaded = true;
 		return EVENT_STOP;
 	}
 
-
 	EventReturn OnSaveDatabase() anope_override
 	{
+		long start = GetTimeMS();
+
+		/* Only one save can happen at once */
+		this->WaitForSave();
+
+		if (use_journal && !this->NeedsCompaction())
+		{
+			this->WriteJournal();
+			return EVENT_CONTINUE;
+		}
+
 		BackupDatabase();
 
+		/* When shutting down the databases must be written before exiting, so do it here */
+		if (use_thread && !Anope::Quitting)
+		{
+			std::map<Module *, std::iostream *> databases;
+			this->SerializeDatabases(databases, true);
+
+			SaveThread *t = new SaveThread(this, use_journal);
+			for (std::map<Module *, std::iostream *>::iterator it = databases.begin(), it_end = databases.end(); it != it_end; ++it)
+				t->databases.push_back(std::make_pair(this->GetDatabaseName(it->first), static_cast<std::stringstream *>(it->second)));
+
+			try
+			{
+				t->Start();
+				save_thread = t;
+			}
+			catch (const CoreException &ex)
+			{
+				Log(this) << "Unable to save databases: " << ex.GetReason();
+				delete t;
+
+				if (use_journal)
+					full_save = true;
+			}
+
+			stall_time = GetTimeMS() - start;
+			return EVENT_CONTINUE;
+		}
+
 		int i = -1;
-		if (use_fork)
+		/* The journals can only be emptied once the full save is known to have worked, so never fork with them */
+		if (use_fork && !use_journal)
 		{
 			i = fork();
 			if (i > 0)
@@ -230,68 +1214,36 @@ class DBFlatFile : public Module, public Pipe
 
 		try
 		{
-			std::map<Module *, std::fstream *> databases;
+			std::map<Module *, std::iostream *> databases;
+			this->SerializeDatabases(databases, false);
 
-			SaveData data;
-			const std::list<Serializable *> &items = Serializable::GetItems();
-			for (std::list<Serializable *>::const_iterator it = items.begin(), it_end = items.end(); it != it_end; ++it)
+			for (std::map<Module *, std::iostream *>::iterator it = databases.begin(), it_end = databases.end(); it != it_end; ++it)
 			{
-				Serializable *base = *it;
-				Serialize::Type *s_type = base->GetSerializableType();
-
-				if (!s_type)
-					continue;
-
-				data.fs = databases[s_type->GetOwner()];
-
-				if (!data.fs)
-				{
-					Anope::string db_name;
-					if (s_type->GetOwner())
-						db_name = Anope::DataDir + "/module_" + s_type->GetOwner()->name + ".db";
-					else
-						db_name = Anope::DataDir + "/" + database_file;
-
-					if (Anope::IsFile(db_name))
-						rename(db_name.c_str(), (db_name + ".tmp").c_str());
-
-					data.fs = databases[s_type->GetOwner()] = new std::fstream(db_name.c_str(), std::ios_base::out | std::ios_base::trunc);
-
-					if (!data.fs->is_open())
-					{
-						Log(this) << "Unable to open " << db_name << " for writing";
-						continue;
-					}
-				}
-				else if (!data.fs->is_open())
-					continue;
+				std::iostream *f = it->second;
+				const Anope::string &db_name = this->GetDatabaseName(it->first);
 
-				*data.fs << "OBJECT " << s_type->GetName();
-				base->Serialize(data);
-				*data.fs << "\nEND\n";
-			}
-
-			for (std::map<Module *, std::fstream *>::iterator it = databases.begin(), it_end = databases.end(); it != it_end; ++it)
-			{
-				std::fstream *f = it->second;
-				const Anope::string &db_name = Anope::DataDir + "/" + (it->first ? (it->first->name + ".db") : database_file);
+				f->flush();
+				bool failed = f->fail();
+				delete f;
 
-				if (!f->is_open() || !f->good())
+				if (failed)
 				{
 					this->Write("Unable to write database " + db_name);
 
-					f->close();
+					if (use_journal)
+						full_save = true;
 
 					if (Anope::IsFile((db_name + ".tmp").c_str()))
-						rename((db_name + ".tmp").c_str(), db_name.c_str());
+						Anope::ReplaceFile(db_name + ".tmp", db_name);
 				}
 				else
 				{
-					f->close();
 					unlink((db_name + ".tmp").c_str());
-				}
 
-				delete f;
+					/* Everything in the journal is in the database now */
+					if (use_journal)
+						unlink((db_name + ".journal").c_str());
+				}
 			}
 		}
 		catch (...)
@@ -306,6 +1258,9 @@ class DBFlatFile : public Module, public Pipe
 			exit(0);
 		}
 
+		stall_time = GetTimeMS() - start;
+		Log(LOG_DEBUG) << "db_flatfile: Saved databases in " << stall_time << "ms";
+
 		return EVENT_CONTINUE;
 	}
 
@@ -315,35 +1270,95 @@ class DBFlatFile : public Module, public Pipe
 		if (!loaded)
 			return;
 
-		Anope::string db_name;
-		if (stype->GetOwner())
-			db_name = Anope::DataDir + "/module_" + stype->GetOwner()->name + ".db";
-		else
-			db_name = Anope::DataDir + "/" + database_file;
+		const Anope::string &db_name = this->GetDatabaseName(stype->GetOwner());
 
-		std::fstream fd(db_name.c_str(), std::ios_base::in);
-		if (!fd.is_open())
-		{
-			Log(this) << "Unable to open " << db_name << " for reading!";
-			return;
-		}
+		/* Don't read the database while it is being written */
+		this->WaitForSave();
 
-		LoadData ld;
-		ld.fs = &fd;
+		loading = true;
 
-		for (Anope::string buf; std::getline(fd, buf.str());)
+		DatabaseFile db;
+		if (db.Open(db_name))
 		{
-			if (buf == "OBJECT " + stype->GetName())
+			std::map<Anope::string, std::vector<const char *> > positions;
+			FindObjects(db, positions);
+
+			std::vector<const char *> &pos = positions[stype->GetName()];
+
+			LoadData ld(db);
+			for (unsigned j = 0; j < pos.size(); ++j)
 			{
-				stype->Unserialize(NULL, ld);
-				ld.Reset();
+				ld.Load(pos[j]);
+				this->LoadObject(stype, ld);
 			}
 		}
+		else
+			Log(this) << "Unable to open " << db_name << " for reading!";
+
+		if (use_journal)
+			this->ReplayJournal(db_name, stype);
 
-		fd.close();
+		loading = false;
+		Serializable::NextGeneration();
 	}
-};
 
-MODULE_INIT(DBFlatFile)
+	void OnSerializableConstruct(Serializable *obj) anope_override
+	{
+		this->OnSerializableUpdate(obj);
+	}
+
+	void OnSerializableDestruct(Serializable *obj) anope_override
+	{
+		if (!use_journal)
+			return;
+
+		updated_items.erase(obj);
+
+		Serialize::Type *s_type = obj->GetSerializableType();
+		if (!s_type || !obj->id)
+			return;
+
+		s_type->objects.erase(obj->id);
+
+		if (loading || unloading.count(s_type->GetOwner()))
+			return;
+
+		deleted_items[s_type->GetOwner()] += "DELETE " + s_type->GetName() + " " + stringify(obj->id) + "\n";
+		++deleted_count;
+	}
+
+	void OnSerializableUpdate(Serializable *obj) anope_override
+	{
+		if (!use_journal || loading)
+			return;
+
+		Reference<Serializable> &ref = updated_items[obj];
+		if (!ref)
+			ref = obj;
+	}
+
+	void OnModuleLoad(User *, Module *m) anope_override
+	{
+		unloading.erase(m);
+	}
+
+	void OnModuleUnload(User *, Module *m) anope_override
+	{
+		if (!use_journal)
+			return;
 
+		/* Write the module's objects out before they are destroyed */
+		if (loaded && !full_save)
+			this->WriteJournal();
 
+		unloading.insert(m);
+	}
+};
+
+void SaveThread::OnNotify()
+{
+	module->OnSaveFinished(this);
+	Thread::OnNotify();
+}
+
+MODULE_INIT(DBFlatFile)
@@ -242,7 +242,7 @@ EventReturn OnDatabaseReadMetadata(ChannelInfo *ci, const Anope::string &key, co
 			Anope::string setter = params[2];
 			time_t mcreated = params[3].is_pos_number_only() ? convertTo<time_t>(params[3]) : Anope::CurTime;
 			Anope::string param = params.size() > 4 ? params[4] : "";
-			const Anope::string* ChannelModeNameStrings = Flags<ChannelModeName>::GetFlagStrings();
+			const Anope::string* ChannelModeNameStrings = Flags<ChannelModeName, CMODE_END * 2>::GetFlagStrings();
 			for (size_t i = CMODE_BEGIN + 1; i < CMODE_END; ++i)
 				if (ChannelModeNameStrings[i] == mode_name)
 				{
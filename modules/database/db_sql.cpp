@@ -129,6 +129,7 @@ class DBSQL : public Module, public Pipe
 		}
 
 		this->updated_items.clear();
+		Serializable::NextGeneration();
 	}
 
 	void OnReload() anope_override
@@ -190,9 +191,8 @@ class DBSQL : public Module, public Pipe
 
 	void OnSerializableUpdate(Serializable *obj) anope_override
 	{
-		if (this->shutting_down || obj->IsTSCached())
+		if (this->shutting_down)
 			return;
-		obj->UpdateTS();
 		this->updated_items.insert(obj);
 		this->Notify();
 	}
@@ -2,8 +2,48 @@
 #include "../extra/sql.h"
 #include "../commands/os_session.h"
 
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
 using namespace SQL;
 
+class DBMySQL;
+
+/* Receives the rows of a type which have changed since it was last polled */
+class ChangeFeed : public Interface
+{
+	DBMySQL *module;
+
+ public:
+	/* The type's name. The type may be gone by the time the results arrive */
+	Anope::string type;
+	/* Rows changed since this time are requested by the next poll */
+	time_t since;
+	/* When the pending query was sent */
+	time_t sent;
+	/* Whether a query is pending */
+	bool pending;
+	/* Ids of objects written or deleted while the query was pending. Their rows in the results may be out of date */
+	std::set<unsigned int> changed;
+
+	ChangeFeed(DBMySQL *m, const Anope::string &t, time_t s);
+
+	void OnResult(const Result &r) anope_override;
+
+	void OnError(const Result &r) anope_override;
+};
+
+class PollTimer : public Timer
+{
+	DBMySQL *module;
+
+ public:
+	PollTimer(DBMySQL *m) : Timer(1, Anope::CurTime, true), module(m) { }
+
+	void Tick(time_t) anope_override;
+};
+
 class DBMySQL : public Module, public Pipe
 {
  private:
@@ -13,7 +53,13 @@ class DBMySQL : public Module, public Pipe
 	time_t lastwarn;
 	bool ro;
 	bool init;
-	std::set<Reference<Serializable> > updated_items;
+	/* Objects changed since the last flush */
+	std::map<Serializable *, Reference<Serializable> > updated_items;
+	/* Ids of objects deleted since the last flush, by type name */
+	std::map<Anope::string, std::set<unsigned int> > deleted_items;
+	/* Change feeds, by type name */
+	std::map<Anope::string, ChangeFeed *> feeds;
+	PollTimer poll_timer;
 
 	bool CheckSQL()
 	{
@@ -66,26 +112,49 @@ class DBMySQL : public Module, public Pipe
 	}
 
  public:
-	DBMySQL(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE), SQL("", "")
+	DBMySQL(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, DATABASE), SQL("", ""), poll_timer(this)
 	{
 		this->lastwarn = 0;
 		this->ro = false;
 		this->init = false;
 
-		Implementation i[] = { I_OnReload, I_OnShutdown, I_OnLoadDatabase, I_OnSerializableConstruct, I_OnSerializableDestruct, I_OnSerializeCheck, I_OnSerializableUpdate };
+		Implementation i[] = { I_OnReload, I_OnShutdown, I_OnLoadDatabase, I_OnSerializableConstruct, I_OnSerializableDestruct, I_OnSerializableUpdate, I_OnSerializeTypeCreate };
 		ModuleManager::Attach(i, this, sizeof(i) / sizeof(Implementation));
 
 		OnReload();
 	}
 
+	~DBMySQL()
+	{
+		for (std::map<Anope::string, ChangeFeed *>::iterator it = this->feeds.begin(), it_end = this->feeds.end(); it != it_end; ++it)
+			delete it->second;
+	}
+
 	void OnNotify() anope_override
 	{
-		if (!this->CheckInit())
+		this->Flush();
+	}
+
+	/** Writes every queued change to SQL in one transaction. Changes to existing objects are written
+	 * a few hundred rows to a statement, and deletions one statement for each type.
+	 */
+	void Flush()
+	{
+		if (!this->CheckInit() || (this->updated_items.empty() && this->deleted_items.empty()))
 			return;
 
-		for (std::set<Reference<Serializable> >::iterator it = this->updated_items.begin(), it_end = this->updated_items.end(); it != it_end; ++it)
+		timeval start;
+		gettimeofday(&start, NULL);
+
+		size_t updates = this->updated_items.size(), deletes = 0, statements = 2;
+		/* Changes to objects which already have ids, by type */
+		std::map<Serialize::Type *, std::vector<std::pair<unsigned int, Data *> > > rows;
+
+		this->RunQuery(Query("BEGIN"));
+
+		for (std::map<Serializable *, Reference<Serializable> >::iterator it = this->updated_items.begin(), it_end = this->updated_items.end(); it != it_end; ++it)
 		{
-			Reference<Serializable> obj = *it;
+			Reference<Serializable> obj = it->second;
 
 			if (obj && this->SQL)
 			{
@@ -107,28 +176,82 @@ class DBMySQL : public Module, public Pipe
 				std::vector<Query> create = this->SQL->CreateTable(this->prefix + s_type->GetName(), *data);
 				for (unsigned i = 0; i < create.size(); ++i)
 					this->RunQueryResult(create[i]);
+				statements += create.size();
+
+				if (obj->id)
+				{
+					rows[s_type].push_back(std::make_pair(obj->id, data));
+					this->Changed(s_type, obj->id);
+					continue;
+				}
 
+				/* obj is new, and its id is needed, so it is inserted alone */
 				Result res = this->RunQueryResult(this->SQL->BuildInsert(this->prefix + s_type->GetName(), obj->id, *data));
+				++statements;
 				if (obj->id != res.GetID())
 				{
 					/* In this case obj is new, so place it into the object map */
 					obj->id = res.GetID();
 					s_type->objects[obj->id] = obj;
 				}
+
+				this->Changed(s_type, obj->id);
 			}
 		}
 
 		this->updated_items.clear();
+		Serializable::NextGeneration();
+
+		for (std::map<Serialize::Type *, std::vector<std::pair<unsigned int, Data *> > >::iterator it = rows.begin(), it_end = rows.end(); it != it_end; ++it)
+			for (unsigned i = 0; i < it->second.size(); i += 250)
+			{
+				std::vector<std::pair<unsigned int, Data *> > batch(it->second.begin() + i, it->second.begin() + std::min<size_t>(i + 250, it->second.size()));
+				this->RunQuery(this->SQL->BuildInsert(this->prefix + it->first->GetName(), batch));
+				++statements;
+			}
+
+		for (std::map<Anope::string, std::set<unsigned int> >::iterator it = this->deleted_items.begin(), it_end = this->deleted_items.end(); it != it_end; ++it)
+		{
+			Anope::string ids;
+			for (std::set<unsigned int>::iterator it2 = it->second.begin(), it2_end = it->second.end(); it2 != it2_end; ++it2)
+				ids += (ids.empty() ? "" : ",") + stringify(*it2);
+			this->RunQuery("DELETE FROM `" + this->prefix + it->first + "` WHERE `id` IN (" + ids + ")");
+			deletes += it->second.size();
+			++statements;
+		}
+
+		this->deleted_items.clear();
+
+		this->RunQuery(Query("COMMIT"));
+
+		timeval end;
+		gettimeofday(&end, NULL);
+		long flush_time = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+
+		/* Slow flushes block everything else, so always say when they happen */
+		Log(flush_time >= 1000 ? LOG_NORMAL : LOG_DEBUG) << "SQL-live flushed " << updates << " updated and " << deletes << " deleted objects with " << statements << " statements in " << flush_time << "ms";
 	}
 
 	EventReturn OnLoadDatabase() anope_override
 	{
 		init = true;
+
+		/* Everything is loaded now, after which only changes are polled for */
+		const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
+		for (unsigned i = 0; i < type_order.size(); ++i)
+		{
+			Serialize::Type *stype = Serialize::Type::Find(type_order[i]);
+			if (stype)
+				this->LoadType(stype);
+		}
+
 		return EVENT_STOP;
 	}
 
 	void OnShutdown() anope_override
 	{
+		/* Write what's waiting, there won't be another chance */
+		this->Flush();
 		init = false;
 	}
 
@@ -138,13 +261,23 @@ class DBMySQL : public Module, public Pipe
 		this->engine = config.ReadValue("db_sql", "engine", "", 0);
 		this->SQL = ServiceReference<Provider>("SQL::Provider", this->engine);
 		this->prefix = config.ReadValue("db_sql", "prefix", "anope_db_", 0);
+
+		time_t poll = Anope::DoTime(config.ReadValue("db_sql", "poll", "1", 0));
+		this->poll_timer.SetSecs(poll > 0 ? poll : 1);
+	}
+
+	void OnSerializeTypeCreate(Serialize::Type *stype) anope_override
+	{
+		/* Types created before the databases are loaded are loaded in OnLoadDatabase */
+		if (this->CheckInit())
+			this->LoadType(stype);
 	}
 
 	void OnSerializableConstruct(Serializable *obj) anope_override
 	{
 		if (!this->CheckInit())
 			return;
-		this->updated_items.insert(obj);
+		this->updated_items[obj] = obj;
 		this->Notify();
 	}
 
@@ -155,21 +288,114 @@ class DBMySQL : public Module, public Pipe
 		Serialize::Type *s_type = obj->GetSerializableType();
 		if (!s_type)
 			return;
-		this->RunQuery("DELETE FROM `" + this->prefix + s_type->GetName() + "` WHERE `id` = " + stringify(obj->id));
+		if (obj->id)
+		{
+			this->deleted_items[s_type->GetName()].insert(obj->id);
+			this->Changed(s_type, obj->id);
+		}
 		s_type->objects.erase(obj->id);
+		this->updated_items.erase(obj);
+		this->Notify();
+	}
+
+	void OnSerializableUpdate(Serializable *obj) anope_override
+	{
+		this->updated_items[obj] = obj;
+		this->Notify();
 	}
 
-	void OnSerializeCheck(Serialize::Type *obj) anope_override
+	/** Loads every object of a type, waiting for the results
+	 * @param stype The type
+	 */
+	void LoadType(Serialize::Type *stype)
 	{
-		if (!this->CheckInit() || obj->GetTimestamp() == Anope::CurTime)
+		ChangeFeed *&feed = this->feeds[stype->GetName()];
+		if (!feed)
+			feed = new ChangeFeed(this, stype->GetName(), 0);
+
+		time_t now = Anope::CurTime;
+		try
+		{
+			Result res = this->RunQueryResult("SELECT * FROM `" + this->prefix + stype->GetName() + "`");
+			if (res)
+			{
+				this->ApplyChanges(stype, res, NULL);
+				feed->since = now;
+			}
+		}
+		catch (const SQL::Exception &) { }
+	}
+
+	/** Requests the rows of every type which have changed since they were last polled.
+	 * The results are applied when they arrive, so this never waits for SQL.
+	 */
+	void Poll()
+	{
+		if (!this->CheckInit() || !this->CheckSQL())
 			return;
 
-		Query query("SELECT * FROM `" + this->prefix + obj->GetName() + "` WHERE (`timestamp` > " + this->SQL->FromUnixtime(obj->GetTimestamp()) + " OR `timestamp` IS NULL)");
+		const std::vector<Anope::string> &type_order = Serialize::Type::GetTypeOrder();
+		for (unsigned i = 0; i < type_order.size(); ++i)
+		{
+			const Anope::string &type_name = type_order[i];
+
+			ChangeFeed *&feed = this->feeds[type_name];
+			if (!feed)
+				feed = new ChangeFeed(this, type_name, Anope::CurTime);
+			else if (feed->pending)
+				continue;
+
+			feed->pending = true;
+			feed->sent = Anope::CurTime;
+			feed->changed.clear();
+
+			/* Rows changed in the same second as the last poll may have been missed by it, so they are requested again */
+			this->SQL->Run(feed, "SELECT * FROM `" + this->prefix + type_name + "` WHERE (`timestamp` >= " + this->SQL->FromUnixtime(feed->since) + " OR `timestamp` IS NULL)");
+		}
+	}
 
-		obj->UpdateTimestamp();
+	/** Called when the results of a poll arrive
+	 * @param feed The change feed
+	 * @param res The results
+	 */
+	void OnChanges(ChangeFeed *feed, const Result &res)
+	{
+		feed->pending = false;
+		feed->since = feed->sent;
+
+		Serialize::Type *stype = Serialize::Type::Find(feed->type);
+		if (stype && res.Rows() && this->CheckInit())
+		{
+			/* Write anything changed here first. Objects which really have changed since the rows were read are then
+			 * in feed->changed, and their rows are skipped
+			 */
+			this->Flush();
 
-		Result res = this->RunQueryResult(query);
+			this->ApplyChanges(stype, res, &feed->changed);
+		}
+
+		feed->changed.clear();
+	}
+
+	/** Notes that an object has been written to or deleted from SQL, so rows for it
+	 * in pending results are not applied over it
+	 * @param stype The object's type
+	 * @param id The object's id
+	 */
+	void Changed(Serialize::Type *stype, unsigned int id)
+	{
+		std::map<Anope::string, ChangeFeed *>::iterator it = this->feeds.find(stype->GetName());
+		if (it != this->feeds.end() && it->second->pending)
+			it->second->changed.insert(id);
+	}
 
+	/** Applies rows read from SQL to the objects of a type
+	 * @param obj The type
+	 * @param res The rows
+	 * @param skip If not NULL, rows for objects with these ids are ignored
+	 */
+	void ApplyChanges(Serialize::Type *obj, const Result &res, const std::set<unsigned int> *skip)
+	{
 		bool clear_null = false;
 		for (int i = 0; i < res.Rows(); ++i)
 		{
@@ -186,6 +412,9 @@ class DBMySQL : public Module, public Pipe
 				continue;
 			}
 
+			if (skip && skip->count(id))
+				continue;
+
 			if (res.Get(i, "timestamp").empty())
 			{
 				clear_null = true;
@@ -198,16 +427,16 @@ class DBMySQL : public Module, public Pipe
 			}
 			else
 			{
-				Data *data = new Data();
-
-				for (std::map<Anope::string, Anope::string>::const_iterator it = row.begin(), it_end = row.end(); it != it_end; ++it)
-					(*data)[it->first] << it->second;
-
 				Serializable *s = NULL;
 				std::map<unsigned int, Serializable *>::iterator it = obj->objects.find(id);
 				if (it != obj->objects.end())
 					s = it->second;
 
+				Data *data = new Data();
+
+				for (std::map<Anope::string, Anope::string>::const_iterator it2 = row.begin(), it2_end = row.end(); it2 != it2_end; ++it2)
+					(*data)[it2->first] << it2->second;
+
 				Serializable *new_s = obj->Unserialize(s, *data);
 				if (new_s)
 				{
@@ -230,21 +459,30 @@ class DBMySQL : public Module, public Pipe
 		}
 
 		if (clear_null)
-		{
-			query = "DELETE FROM `" + this->prefix + obj->GetName() + "` WHERE `timestamp` IS NULL";
-			this->RunQuery(query);
-		}
-	}
-
-	void OnSerializableUpdate(Serializable *obj) anope_override
-	{
-		if (obj->IsTSCached())
-			return;
-		obj->UpdateTS();
-		this->updated_items.insert(obj);
-		this->Notify();
+			this->RunQuery("DELETE FROM `" + this->prefix + obj->GetName() + "` WHERE `timestamp` IS NULL");
 	}
 };
 
-MODULE_INIT(DBMySQL)
+ChangeFeed::ChangeFeed(DBMySQL *m, const Anope::string &t, time_t s) : Interface(m), module(m), type(t), since(s), sent(0), pending(false)
+{
+}
 
+void ChangeFeed::OnResult(const Result &r)
+{
+	module->OnChanges(this, r);
+}
+
+void ChangeFeed::OnError(const Result &r)
+{
+	/* Try again on the next poll */
+	this->pending = false;
+	this->changed.clear();
+	Log(LOG_DEBUG) << "SQL-live got error " << r.GetError() << " polling " << this->type;
+}
+
+void PollTimer::Tick(time_t)
+{
+	module->Poll();
+}
+
+MODULE_INIT(DBMySQL)
@@ -12,6 +12,7 @@ using namespace DNS;
 
 static ServiceReference<XLineManager> akills("XLineManager", "xlinemanager/sgline");
 static ServiceReference<Manager> dnsmanager("DNS::Manager", "dns/manager");
+static ExtensibleKey akilled_key("m_dnsbl_akilled");
 
 struct Blacklist
 {
@@ -34,7 +35,7 @@ class DNSBLResolver : public Request
 
 	void OnLookupComplete(const Query *record) anope_override
 	{
-		if (!user || user->HasExt("m_dnsbl_akilled"))
+		if (!user || user->HasExt(akilled_key))
 			return;
 
 		const ResourceRecord &ans_record = record->answers[0];
@@ -54,7 +55,7 @@ class DNSBLResolver : public Request
 			record_reason = this->blacklist.replies[result];
 		}
 
-		user->Extend("m_dnsbl_akilled", NULL);
+		user->Extend(akilled_key, NULL);
 
 		Anope::string reason = this->blacklist.reason;
 		reason = reason.replace_all_cs("%n", user->nick);
@@ -343,10 +343,11 @@ class HTTPD : public Module
 
 	~HTTPD()
 	{
-		for (std::map<int, Socket *>::const_iterator it = SocketEngine::Sockets.begin(), it_end = SocketEngine::Sockets.end(); it != it_end;)
+		for (unsigned i = 0; i < SocketEngine::Sockets.size(); ++i)
 		{
-			Socket *s = it->second;
-			++it;
+			Socket *s = SocketEngine::Sockets[i];
+			if (s == NULL)
+				continue;
 
 			if (dynamic_cast<MyHTTPProvider *>(s) || dynamic_cast<MyHTTPClient *>(s))
 				delete s;
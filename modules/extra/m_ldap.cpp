@@ -4,7 +4,7 @@
 #include "ldap.h"
 #include <ldap.h>
 
-static Pipe *me;
+static Completion *me;
 
 class LDAPService : public LDAPProvider, public Thread, public Condition
 {
@@ -393,12 +393,12 @@ class LDAPService : public LDAPProvider, public Thread, public Condition
 			this->results.push_back(std::make_pair(i, ldap_result));
 			this->Unlock();
 
-			me->Notify();
+			CompletionQueue::Post(me);
 		}
 	}
 };
 
-class ModuleLDAP : public Module, public Pipe
+class ModuleLDAP : public Module, public Completion
 {
 	std::map<Anope::string, LDAPService *> LDAPServices;
  public:
@@ -509,7 +509,7 @@ class ModuleLDAP : public Module, public Pipe
 		} 
 	}
 
-	void OnNotify() anope_override
+	void OnComplete() anope_override
 	{
 		for (std::map<Anope::string, LDAPService *>::iterator it = this->LDAPServices.begin(); it != this->LDAPServices.end(); ++it)
 		{
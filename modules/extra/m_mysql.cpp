@@ -7,14 +7,22 @@
 
 using namespace SQL;
 
+/* MySQL 8 replaced my_bool with bool, MariaDB still has it */
+#if !defined(MARIADB_BASE_VERSION) && !defined(MARIADB_VERSION_ID) && MYSQL_VERSION_ID >= 80001
+typedef bool my_bool;
+#endif
+
+/* How many prepared statements each connection keeps */
+static const unsigned MaxStatements = 64;
+
 /** Non blocking threaded MySQL API, based loosely from InspIRCd's m_mysql.cpp
  *
  * This module spawns a single thread that is used to execute blocking MySQL queries.
  * When a module requests a query to be executed it is added to a list for the thread
  * (which never stops looping and sleeing) to pick up and execute, the result of which
- * is inserted in to another queue to be picked up by the main thread. The main thread
- * uses Pipe to become notified through the socket engine when there are results waiting
- * to be sent back to the modules requesting the query
+ * is inserted in to another queue to be picked up by the main thread. The module is
+ * posted to the CompletionQueue when there are results waiting to be sent back to the
+ * modules requesting the query
  */
 
 class MySQLService;
@@ -81,6 +89,83 @@ class MySQLResult : public Result
 		}
 	}
 
+	/* Where a column of a prepared statement's result is fetched to */
+	struct Column
+	{
+		std::vector<char> buffer;
+		unsigned long length;
+		my_bool is_null;
+
+		Column() : buffer(64), length(0), is_null(0) { }
+	};
+
+	/** Fetches the rows of an executed prepared statement
+	 * @param meta The result metadata of the statement, if it returns rows
+	 */
+	MySQLResult(unsigned int i, const Query &q, const Anope::string &fq, MYSQL_STMT *stmt, MYSQL_RES *meta) : Result(i, q, fq), res(NULL)
+	{
+		unsigned num_fields = meta ? mysql_num_fields(meta) : 0;
+
+		if (!num_fields)
+			return;
+
+		MYSQL_FIELD *fields = mysql_fetch_fields(meta);
+		if (!fields)
+			return;
+
+		/* Columns are fetched as strings in to buffers which are grown and fetched again when a value doesn't fit */
+		std::vector<MYSQL_BIND> bind(num_fields);
+		std::vector<Column> columns(num_fields);
+		for (unsigned field_count = 0; field_count < num_fields; ++field_count)
+		{
+			bind[field_count].buffer_type = MYSQL_TYPE_STRING;
+			bind[field_count].buffer = &columns[field_count].buffer[0];
+			bind[field_count].buffer_length = columns[field_count].buffer.size();
+			bind[field_count].length = &columns[field_count].length;
+			bind[field_count].is_null = &columns[field_count].is_null;
+		}
+
+		if (mysql_stmt_bind_result(stmt, &bind[0]))
+			return;
+
+		for (int err; !(err = mysql_stmt_fetch(stmt)) || err == MYSQL_DATA_TRUNCATED;)
+		{
+			std::map<Anope::string, Anope::string> items;
+			bool rebind = false;
+
+			for (unsigned field_count = 0; field_count < num_fields; ++field_count)
+			{
+				Anope::string column = (fields[field_count].name ? fields[field_count].name : "");
+
+				/* The buffer and length are left as they were for the last row when a value is NULL */
+				if (columns[field_count].is_null)
+				{
+					items[column] = "";
+					continue;
+				}
+
+				std::vector<char> &buffer = columns[field_count].buffer;
+				unsigned long length = columns[field_count].length;
+
+				if (length > buffer.size())
+				{
+					buffer.resize(length);
+					bind[field_count].buffer = &buffer[0];
+					bind[field_count].buffer_length = length;
+					mysql_stmt_fetch_column(stmt, &bind[field_count], field_count, 0);
+					rebind = true;
+				}
+
+				items[column] = Anope::string(&buffer[0], length);
+			}
+
+			this->entries.push_back(items);
+
+			if (rebind && mysql_stmt_bind_result(stmt, &bind[0]))
+				break;
+		}
+	}
+
 	MySQLResult(const Query &q, const Anope::string &fq, const Anope::string &err) : Result(0, q, fq, err), res(NULL)
 	{
 	}
@@ -106,10 +191,28 @@ class MySQLService : public Provider
 
 	MYSQL *sql;
 
+	/* Statements prepared from queries with parameters, by text, most recently used first.
+	 * Statements that can't be prepared are kept as NULL, so they aren't tried again.
+	 */
+	typedef std::list<std::pair<Anope::string, MYSQL_STMT *> > StatementList;
+	StatementList statements;
+	std::map<Anope::string, StatementList::iterator> statement_map;
+
 	/** Escape a query.
 	 * Note the mutex must be held!
 	 */
 	Anope::string Escape(const Anope::string &query);
+	friend class QueryText<MySQLService>;
+
+	/** Gets the statement for the text of a prepared query, preparing it if it isn't cached.
+	 * Note the mutex must be held!
+	 * @return The statement, or NULL if it can't be prepared
+	 */
+	MYSQL_STMT *Prepare(const Anope::string &text);
+
+	/** Closes every prepared statement
+	 */
+	void ClearStatements();
 
  public:
 	/* Locked by the SQL thread when a query is pending on this database,
@@ -130,6 +233,8 @@ class MySQLService : public Provider
 
 	Query BuildInsert(const Anope::string &table, unsigned int id, Data &data) anope_override;
 
+	Query BuildInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows) anope_override;
+
 	Query GetTables(const Anope::string &prefix) anope_override;
 
 	void Connect();
@@ -153,7 +258,7 @@ class DispatcherThread : public Thread, public Condition
 
 class ModuleSQL;
 static ModuleSQL *me;
-class ModuleSQL : public Module, public Pipe
+class ModuleSQL : public Module, public Completion
 {
 	/* SQL connections */
 	std::map<Anope::string, MySQLService *> MySQLServices;
@@ -267,10 +372,10 @@ class ModuleSQL : public Module, public Pipe
 
 		this->DThread->Unlock();
 
-		this->OnNotify();
+		this->OnComplete();
 	}
 
-	void OnNotify() anope_override
+	void OnComplete() anope_override
 	{
 		this->DThread->Lock();
 		std::deque<QueryResult> finishedRequests = this->FinishedRequests;
@@ -282,7 +387,7 @@ class ModuleSQL : public Module, public Pipe
 			const QueryResult &qr = *it;
 
 			if (!qr.sqlinterface)
-				throw SQL::Exception("NULL qr.sqlinterface in MySQLPipe::OnNotify() ?");
+				throw SQL::Exception("NULL qr.sqlinterface in ModuleSQL::OnComplete() ?");
 
 			if (qr.result.GetError().empty())
 				qr.sqlinterface->OnResult(qr.result);
@@ -302,6 +407,7 @@ MySQLService::~MySQLService()
 {
 	me->DThread->Lock();
 	this->Lock.Lock();
+	this->ClearStatements();
 	mysql_close(this->sql);
 	this->sql = NULL;
 
@@ -332,9 +438,50 @@ Result MySQLService::RunQuery(const Query &query)
 {
 	this->Lock.Lock();
 
+	/* Pinging the server is a round trip of its own, so it is only done once per query */
+	bool connected = this->CheckConnection();
+
+	PreparedQuery prepared;
+	MYSQL_STMT *stmt = NULL;
+	if (connected && prepared.Build(query))
+		stmt = this->Prepare(prepared.text);
+
+	if (stmt)
+	{
+		std::vector<MYSQL_BIND> bind(prepared.values.size());
+		std::vector<unsigned long> lengths(prepared.values.size());
+		for (unsigned i = 0; i < prepared.values.size(); ++i)
+		{
+			bind[i].buffer_type = MYSQL_TYPE_STRING;
+			bind[i].buffer = const_cast<char *>(prepared.values[i]->c_str());
+			bind[i].buffer_length = lengths[i] = prepared.values[i]->length();
+			bind[i].length = &lengths[i];
+		}
+
+		if (!mysql_stmt_bind_param(stmt, &bind[0]) && !mysql_stmt_execute(stmt))
+		{
+			MYSQL_RES *meta = mysql_stmt_result_metadata(stmt);
+			unsigned int id = mysql_stmt_insert_id(stmt);
+			MySQLResult result(id, query, prepared.text, stmt, meta);
+
+			if (meta)
+				mysql_free_result(meta);
+			mysql_stmt_free_result(stmt);
+
+			this->Lock.Unlock();
+			return result;
+		}
+		else
+		{
+			Anope::string error = mysql_stmt_error(stmt), real_query = this->BuildQuery(query);
+			this->Lock.Unlock();
+			return MySQLResult(query, real_query, error);
+		}
+	}
+
 	Anope::string real_query = this->BuildQuery(query);
 
-	if (this->CheckConnection() && !mysql_real_query(this->sql, real_query.c_str(), real_query.length()))
+	if (connected && !mysql_real_query(this->sql, real_query.c_str(), real_query.length()))
 	{
 		MYSQL_RES *res = mysql_store_result(this->sql);
 		unsigned int id = mysql_insert_id(this->sql);
@@ -417,7 +564,7 @@ Query MySQLService::BuildInsert(const Anope::string &table, unsigned int id, Dat
 	Anope::string query_text = "INSERT INTO `" + table + "` (`id`";
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 		query_text += ",`" + it->first + "`";
-	query_text += ") VALUES (" + stringify(id);
+	query_text += ") VALUES (@id@";
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 		query_text += ",@" + it->first + "@";
 	query_text += ") ON DUPLICATE KEY UPDATE ";
@@ -426,6 +573,7 @@ Query MySQLService::BuildInsert(const Anope::string &table, unsigned int id, Dat
 	query_text.erase(query_text.end() - 1);
 
 	Query query(query_text);
+	query.SetValue("id", id);
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 	{
 		Anope::string buf;
@@ -436,6 +584,45 @@ Query MySQLService::BuildInsert(const Anope::string &table, unsigned int id, Dat
 	return query;
 }
 
+Query MySQLService::BuildInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows)
+{
+	/* Every row needs the same columns, so columns missing from a row are emptied */
+	std::set<Anope::string> columns = this->active_schema[table];
+	columns.erase("id");
+	columns.erase("timestamp");
+	for (unsigned i = 0; i < rows.size(); ++i)
+		for (Data::Map::const_iterator it = rows[i].second->data.begin(), it_end = rows[i].second->data.end(); it != it_end; ++it)
+			columns.insert(it->first);
+
+	Query query;
+	Anope::string query_text = "INSERT INTO `" + table + "` (`id`";
+	for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it)
+		query_text += ",`" + *it + "`";
+	query_text += ") VALUES ";
+	for (unsigned i = 0; i < rows.size(); ++i)
+	{
+		query_text += (i ? ",(@" : "(@") + stringify(i) + ":id@";
+		query.SetValue(stringify(i) + ":id", rows[i].first);
+		for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it)
+		{
+			Anope::string key = stringify(i) + ":" + *it, buf;
+			Data::Map::const_iterator col = rows[i].second->data.find(*it);
+			if (col != rows[i].second->data.end())
+				*col->second >> buf;
+
+			query_text += ",@" + key + "@";
+			query.SetValue(key, buf);
+		}
+		query_text += ")";
+	}
+	query_text += " ON DUPLICATE KEY UPDATE ";
+	for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it)
+		query_text += "`" + *it + "`=VALUES(`" + *it + "`),";
+	query_text.erase(query_text.end() - 1);
+	query.query = query_text;
+	return query;
+}
+
 Query MySQLService::GetTables(const Anope::string &prefix)
 {
 	return Query("SHOW TABLES LIKE '" + prefix + "%';");
@@ -443,6 +630,9 @@ Query MySQLService::GetTables(const Anope::string &prefix)
 
 void MySQLService::Connect()
 {
+	/* Statements belong to the connection they were prepared on */
+	this->ClearStatements();
+
 	this->sql = mysql_init(this->sql);
 
 	const unsigned int timeout = 1;
@@ -474,6 +664,50 @@ bool MySQLService::CheckConnection()
 	return true;
 }
 
+MYSQL_STMT *MySQLService::Prepare(const Anope::string &text)
+{
+	std::map<Anope::string, StatementList::iterator>::iterator it = this->statement_map.find(text);
+	if (it != this->statement_map.end())
+	{
+		this->statements.splice(this->statements.begin(), this->statements, it->second);
+		return it->second->second;
+	}
+
+	/* Procedures can return more than one result, which the statement API only reads one of */
+	MYSQL_STMT *stmt = NULL;
+	if (!text.substr(0, 5).equals_ci("CALL "))
+	{
+		stmt = mysql_stmt_init(this->sql);
+		if (stmt && mysql_stmt_prepare(stmt, text.c_str(), text.length()))
+		{
+			mysql_stmt_close(stmt);
+			stmt = NULL;
+		}
+	}
+
+	this->statements.push_front(std::make_pair(text, stmt));
+	this->statement_map[text] = this->statements.begin();
+
+	if (this->statements.size() > MaxStatements)
+	{
+		if (this->statements.back().second)
+			mysql_stmt_close(this->statements.back().second);
+		this->statement_map.erase(this->statements.back().first);
+		this->statements.pop_back();
+	}
+
+	return stmt;
+}
+
+void MySQLService::ClearStatements()
+{
+	for (StatementList::iterator it = this->statements.begin(), it_end = this->statements.end(); it != it_end; ++it)
+		if (it->second)
+			mysql_stmt_close(it->second);
+	this->statements.clear();
+	this->statement_map.clear();
+}
+
 Anope::string MySQLService::Escape(const Anope::string &query)
 {
 	char buffer[BUFSIZE];
@@ -483,12 +717,9 @@ Anope::string MySQLService::Escape(const Anope::string &query)
 
 Anope::string MySQLService::BuildQuery(const Query &q)
 {
-	Anope::string real_query = q.query;
-
-	for (std::map<Anope::string, QueryData>::const_iterator it = q.parameters.begin(), it_end = q.parameters.end(); it != it_end; ++it)
-		real_query = real_query.replace_all_cs("@" + it->first + "@", (it->second.escape ? ("'" + this->Escape(it->second.data) + "'") : it->second.data));
-
-	return real_query;
+	QueryText<MySQLService> real_query(this);
+	real_query.Visit(q);
+	return real_query.text;
 }
 
 Anope::string MySQLService::FromUnixtime(time_t t)
@@ -520,7 +751,7 @@ void DispatcherThread::Run()
 		else
 		{
 			if (!me->FinishedRequests.empty())
-				me->Notify();
+				CompletionQueue::Post(me);
 			this->Wait();
 		}
 	}
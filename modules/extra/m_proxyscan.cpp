@@ -36,7 +36,7 @@ class ProxyCallbackListener : public ListenSocket
 
 		bool ProcessWrite() anope_override
 		{
-			return !BufferedSocket::ProcessWrite() || this->write_buffer.empty() ? false : true;
+			return !BufferedSocket::ProcessWrite() || this->write_buffer.Empty() ? false : true;
 		}
 	};
 
@@ -249,10 +249,11 @@ class ModuleProxyScan : public Module
 			delete p;
 		}
 
-		for (std::map<int, Socket *>::const_iterator it = SocketEngine::Sockets.begin(), it_end = SocketEngine::Sockets.end(); it != it_end;)
+		for (unsigned i = 0; i < SocketEngine::Sockets.size(); ++i)
 		{
-			Socket *s = it->second;
-			++it;
+			Socket *s = SocketEngine::Sockets[i];
+			if (s == NULL)
+				continue;
 
 			ClientSocket *cs = dynamic_cast<ClientSocket *>(s);
 			if (cs != NULL && cs->ls == this->listener)
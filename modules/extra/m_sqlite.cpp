@@ -8,6 +8,42 @@ using namespace SQL;
 
 /* SQLite3 API, based from InspiRCd */
 
+/** Queries requested with Run() are executed by a task on the ThreadPool, so a slow disk does not
+ * hold up the main thread. Each database has its own task, which runs every request waiting for the
+ * database together, in one transaction, and the results are sent back to the main thread through the CompletionQueue.
+ * Queries run with RunQuery() are still executed immediately.
+ */
+
+/* How many prepared statements each database keeps */
+static const unsigned MaxStatements = 64;
+/* The most requests run in one transaction */
+static const unsigned MaxBatch = 512;
+
+class SQLiteService;
+
+/** A query request
+ */
+struct QueryRequest
+{
+	/* The interface to use once we have the result to send the data back */
+	Interface *sqlinterface;
+	/* The actual query */
+	Query query;
+
+	QueryRequest(Interface *i, const Query &q) : sqlinterface(i), query(q) { }
+};
+
+/** A query result */
+struct QueryResult
+{
+	/* The interface to send the data back on */
+	Interface *sqlinterface;
+	/* The result */
+	Result result;
+
+	QueryResult(Interface *i, const Result &r) : sqlinterface(i), result(r) { }
+};
+
 /** A SQLite result
  */
 class SQLiteResult : public Result
@@ -27,6 +63,25 @@ class SQLiteResult : public Result
 	}
 };
 
+/** The task used to execute the queries requested for a database
+ */
+class DispatchTask : public Task
+{
+	SQLiteService *service;
+
+ public:
+	/* Whether the task is in the pool, only used by the main thread */
+	bool submitted;
+
+	DispatchTask(SQLiteService *s) : Task(), service(s), submitted(false) { }
+
+	void Run() anope_override;
+
+	/** Submits the task again if requests came in after it finished
+	 */
+	void OnComplete() anope_override;
+};
+
 /** A SQLite database, there can be multiple
  */
 class SQLiteService : public Provider
@@ -37,10 +92,35 @@ class SQLiteService : public Provider
 
 	sqlite3 *sql;
 
+	/* Statements prepared from queries with parameters, by text, most recently used first */
+	typedef std::list<std::pair<Anope::string, sqlite3_stmt *> > StatementList;
+	StatementList statements;
+	std::map<Anope::string, StatementList::iterator> statement_map;
+
 	Anope::string Escape(const Anope::string &query);
+	friend class QueryText<SQLiteService>;
+
+	/** Gets the statement for the text of a prepared query, preparing it if it isn't cached
+	 * @return The statement, or NULL if it couldn't be prepared
+	 */
+	sqlite3_stmt *Prepare(const Anope::string &text);
+
+	/** Steps a prepared statement through all of its rows
+	 */
+	SQLiteResult Step(const Query &query, const Anope::string &real_query, sqlite3_stmt *stmt);
 
  public:
-	SQLiteService(Module *o, const Anope::string &n, const Anope::string &d);
+	/* Locked while a query is executing, as the connection is shared by the main thread and the pool */
+	Mutex Lock;
+	/* Pending query requests, guarded by ModuleSQLite::QueryLock */
+	std::deque<QueryRequest> QueryRequests;
+	/* Executes the pending requests */
+	DispatchTask Dispatcher;
+
+	/** Opens a database
+	 * @param pragmas PRAGMA statements, without the PRAGMA, to configure the connection with
+	 */
+	SQLiteService(Module *o, const Anope::string &n, const Anope::string &d, const std::vector<Anope::string> &pragmas);
 
 	~SQLiteService();
 
@@ -48,10 +128,24 @@ class SQLiteService : public Provider
 
 	Result RunQuery(const Query &query);
 
+	/** Executes a query.
+	 * Note the mutex must be held!
+	 */
+	Result Execute(const Query &query);
+
+	/** Executes many queries, in one transaction if they don't open or close transactions themselves.
+	 * Note the mutex must be held!
+	 * @param requests The requests
+	 * @param results Where to add the results of requests with an interface
+	 */
+	void Execute(const std::deque<QueryRequest> &requests, std::deque<QueryResult> &results);
+
 	std::vector<Query> CreateTable(const Anope::string &table, const Data &data) anope_override;
 
 	Query BuildInsert(const Anope::string &table, unsigned int id, Data &data);
 
+	Query BuildInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows);
+
 	Query GetTables(const Anope::string &prefix);
 
 	Anope::string BuildQuery(const Query &q);
@@ -59,21 +153,43 @@ class SQLiteService : public Provider
 	Anope::string FromUnixtime(time_t);
 };
 
-class ModuleSQLite : public Module
+class ModuleSQLite;
+static ModuleSQLite *me;
+class ModuleSQLite : public Module, public Completion
 {
 	/* SQL connections */
 	std::map<Anope::string, SQLiteService *> SQLiteServices;
  public:
-	ModuleSQLite(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, SUPPORTED)
+	/* Guards the pending requests of every database and the finished requests */
+	Mutex QueryLock;
+	/* Pending finished requests with results */
+	std::deque<QueryResult> FinishedRequests;
+	/* Whether queries are executed on the pool, false if the SQLite library can't be used from threads */
+	bool Threaded;
+
+	ModuleSQLite(const Anope::string &modname, const Anope::string &creator) : Module(modname, creator, SUPPORTED), Threaded(false)
 	{
-		Implementation i[] = { I_OnReload };
+		me = this;
+
+		Implementation i[] = { I_OnReload, I_OnModuleUnload };
 		ModuleManager::Attach(i, this,  sizeof(i) / sizeof(Implementation));
 
+		if (sqlite3_threadsafe())
+			Threaded = true;
+		else
+			Log(LOG_NORMAL, "sqlite") << "SQLite: The SQLite library was built without thread support, all queries will be executed immediately";
+
 		OnReload();
 	}
 
 	~ModuleSQLite()
 	{
+		for (std::map<Anope::string, SQLiteService *>::iterator it = this->SQLiteServices.begin(); it != this->SQLiteServices.end(); ++it)
+			ThreadPool::Cancel(&it->second->Dispatcher);
+
+		this->OnComplete();
+
+		/* Requests the pool did not get to are executed as the databases are closed */
 		for (std::map<Anope::string, SQLiteService *>::iterator it = this->SQLiteServices.begin(); it != this->SQLiteServices.end(); ++it)
 			delete it->second;
 		SQLiteServices.clear();
@@ -111,9 +227,23 @@ class ModuleSQLite : public Module
 			{
 				Anope::string database = Anope::DataDir + "/" + config.ReadValue("sqlite", "database", "anope", i);
 
+				std::vector<Anope::string> pragmas;
+				Anope::string journal_mode = config.ReadValue("sqlite", "journal_mode", "wal", i);
+				if (!journal_mode.empty())
+					pragmas.push_back("journal_mode = " + journal_mode);
+				Anope::string synchronous = config.ReadValue("sqlite", "synchronous", "normal", i);
+				if (!synchronous.empty())
+					pragmas.push_back("synchronous = " + synchronous);
+				Anope::string mmap_size = config.ReadValue("sqlite", "mmap_size", "", i);
+				if (!mmap_size.empty())
+					pragmas.push_back("mmap_size = " + mmap_size);
+				Anope::string cache_size = config.ReadValue("sqlite", "cache_size", "", i);
+				if (!cache_size.empty())
+					pragmas.push_back("cache_size = " + cache_size);
+
 				try
 				{
-					SQLiteService *ss = new SQLiteService(this, connname, database);
+					SQLiteService *ss = new SQLiteService(this, connname, database, pragmas);
 					this->SQLiteServices[connname] = ss;
 
 					Log(LOG_NORMAL, "sqlite") << "SQLite: Successfully added database " << database;
@@ -125,39 +255,224 @@ class ModuleSQLite : public Module
 			}
 		}
 	}
+
+	void OnModuleUnload(User *, Module *m) anope_override
+	{
+		if (!this->Threaded)
+			return;
+
+		/* The module's queries are still executed, so no writes are lost, but nothing is told of the results */
+		this->QueryLock.Lock();
+		for (std::map<Anope::string, SQLiteService *>::iterator it = this->SQLiteServices.begin(); it != this->SQLiteServices.end(); ++it)
+			for (std::deque<QueryRequest>::iterator it2 = it->second->QueryRequests.begin(), it2_end = it->second->QueryRequests.end(); it2 != it2_end; ++it2)
+				if (it2->sqlinterface && it2->sqlinterface->owner == m)
+					it2->sqlinterface = NULL;
+		this->QueryLock.Unlock();
+
+		/* Requests already being executed may be for the module, so wait for their results. A task still waiting in the pool is put back. */
+		for (std::map<Anope::string, SQLiteService *>::iterator it = this->SQLiteServices.begin(); it != this->SQLiteServices.end(); ++it)
+			if (ThreadPool::Cancel(&it->second->Dispatcher))
+				ThreadPool::Submit(&it->second->Dispatcher);
+
+		this->OnComplete();
+	}
+
+	void OnComplete() anope_override
+	{
+		this->QueryLock.Lock();
+		std::deque<QueryResult> finishedRequests = this->FinishedRequests;
+		this->FinishedRequests.clear();
+		this->QueryLock.Unlock();
+
+		for (std::deque<QueryResult>::const_iterator it = finishedRequests.begin(), it_end = finishedRequests.end(); it != it_end; ++it)
+		{
+			const QueryResult &qr = *it;
+
+			if (qr.result.GetError().empty())
+				qr.sqlinterface->OnResult(qr.result);
+			else
+				qr.sqlinterface->OnError(qr.result);
+		}
+	}
 };
 
-SQLiteService::SQLiteService(Module *o, const Anope::string &n, const Anope::string &d)
-: Provider(o, n), database(d), sql(NULL)
+/** Checks whether a query begins or ends a transaction itself
+ */
+static bool IsTransaction(const Query &query)
+{
+	static const char *const keywords[] = { "BEGIN", "COMMIT", "END", "ROLLBACK", "SAVEPOINT", "RELEASE" };
+
+	Anope::string text = query.query;
+	text.trim();
+	Anope::string keyword = text.substr(0, text.find_first_of(" \t\r\n;"));
+
+	for (unsigned i = 0; i < sizeof(keywords) / sizeof(*keywords); ++i)
+		if (keyword.equals_ci(keywords[i]))
+			return true;
+	return false;
+}
+
+SQLiteService::SQLiteService(Module *o, const Anope::string &n, const Anope::string &d, const std::vector<Anope::string> &pragmas)
+: Provider(o, n), database(d), sql(NULL), Dispatcher(this)
 {
 	int db = sqlite3_open_v2(database.c_str(), &this->sql, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, 0);
 	if (db != SQLITE_OK)
 		throw SQL::Exception("Unable to open SQLite database " + database + ": " + sqlite3_errmsg(this->sql));
+
+	for (unsigned i = 0; i < pragmas.size(); ++i)
+	{
+		Anope::string pragma = "PRAGMA " + pragmas[i];
+		if (sqlite3_exec(this->sql, pragma.c_str(), NULL, NULL, NULL) != SQLITE_OK)
+			Log(LOG_NORMAL, "sqlite") << "SQLite: Unable to set " << pragmas[i] << " on " << database << ": " << sqlite3_errmsg(this->sql);
+	}
 }
 
 SQLiteService::~SQLiteService()
 {
-	sqlite3_interrupt(this->sql);
+	/* Take back the requests the pool has not gotten to, once it is done with any it is executing */
+	ThreadPool::Cancel(&this->Dispatcher);
+	me->QueryLock.Lock();
+	std::deque<QueryRequest> requests;
+	requests.swap(this->QueryRequests);
+	me->QueryLock.Unlock();
+
+	std::deque<QueryResult> results;
+	this->Lock.Lock();
+	this->Execute(requests, results);
+	for (StatementList::iterator it = this->statements.begin(), it_end = this->statements.end(); it != it_end; ++it)
+		sqlite3_finalize(it->second);
 	sqlite3_close(this->sql);
+	this->Lock.Unlock();
+
+	for (std::deque<QueryResult>::const_iterator it = results.begin(), it_end = results.end(); it != it_end; ++it)
+	{
+		if (it->result.GetError().empty())
+			it->sqlinterface->OnResult(it->result);
+		else
+			it->sqlinterface->OnError(it->result);
+	}
 }
 
 void SQLiteService::Run(Interface *i, const Query &query)
 {
-	Result res = this->RunQuery(query);
-	if (!res.GetError().empty())
-		i->OnError(res);
-	else
-		i->OnResult(res);
+	if (!me->Threaded)
+	{
+		Result res = this->RunQuery(query);
+		if (i && !res.GetError().empty())
+			i->OnError(res);
+		else if (i)
+			i->OnResult(res);
+		return;
+	}
+
+	me->QueryLock.Lock();
+	this->QueryRequests.push_back(QueryRequest(i, query));
+	me->QueryLock.Unlock();
+
+	if (!this->Dispatcher.submitted)
+	{
+		this->Dispatcher.submitted = true;
+		ThreadPool::Submit(&this->Dispatcher);
+	}
 }
 
 Result SQLiteService::RunQuery(const Query &query)
 {
-	Anope::string real_query = this->BuildQuery(query);
+	this->Lock.Lock();
+	Result result = this->Execute(query);
+	this->Lock.Unlock();
+	return result;
+}
+
+Result SQLiteService::Execute(const Query &query)
+{
+	PreparedQuery prepared;
+	if (!prepared.Build(query) || prepared.values.size() > static_cast<unsigned>(sqlite3_limit(this->sql, SQLITE_LIMIT_VARIABLE_NUMBER, -1)))
+	{
+		/* Queries without parameters are rarely run twice, so they are not kept */
+		Anope::string real_query = this->BuildQuery(query);
+		sqlite3_stmt *stmt;
+		if (sqlite3_prepare_v2(this->sql, real_query.c_str(), real_query.length(), &stmt, NULL) != SQLITE_OK)
+			return SQLiteResult(query, real_query, sqlite3_errmsg(this->sql));
+
+		SQLiteResult result = this->Step(query, real_query, stmt);
+		sqlite3_finalize(stmt);
+		return result;
+	}
+
+	sqlite3_stmt *stmt = this->Prepare(prepared.text);
+	if (!stmt)
+		return SQLiteResult(query, this->BuildQuery(query), sqlite3_errmsg(this->sql));
+
+	for (unsigned i = 0; i < prepared.values.size(); ++i)
+		sqlite3_bind_text(stmt, i + 1, prepared.values[i]->c_str(), prepared.values[i]->length(), SQLITE_STATIC);
+
+	SQLiteResult result = this->Step(query, prepared.text, stmt);
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	if (!result)
+		return SQLiteResult(query, this->BuildQuery(query), result.GetError());
+	return result;
+}
+
+void SQLiteService::Execute(const std::deque<QueryRequest> &requests, std::deque<QueryResult> &results)
+{
+	/* Grouping the queries in to one transaction means they are synced to disk once instead of once each */
+	bool transaction = requests.size() > 1 && sqlite3_get_autocommit(this->sql);
+	for (unsigned i = 0; transaction && i < requests.size(); ++i)
+		if (IsTransaction(requests[i].query))
+			transaction = false;
+	if (transaction)
+		transaction = sqlite3_exec(this->sql, "BEGIN", NULL, NULL, NULL) == SQLITE_OK;
+
+	size_t first = results.size();
+	for (unsigned i = 0; i < requests.size(); ++i)
+	{
+		Result result = this->Execute(requests[i].query);
+		if (requests[i].sqlinterface)
+			results.push_back(QueryResult(requests[i].sqlinterface, result));
+	}
+
+	if (transaction && sqlite3_exec(this->sql, "COMMIT", NULL, NULL, NULL) != SQLITE_OK)
+	{
+		Anope::string error = sqlite3_errmsg(this->sql);
+		sqlite3_exec(this->sql, "ROLLBACK", NULL, NULL, NULL);
+
+		for (size_t i = first; i < results.size(); ++i)
+			if (results[i].result)
+				results[i].result = SQLiteResult(results[i].result.GetQuery(), results[i].result.finished_query, error);
+	}
+}
+
+sqlite3_stmt *SQLiteService::Prepare(const Anope::string &text)
+{
+	std::map<Anope::string, StatementList::iterator>::iterator it = this->statement_map.find(text);
+	if (it != this->statement_map.end())
+	{
+		this->statements.splice(this->statements.begin(), this->statements, it->second);
+		return it->second->second;
+	}
+
 	sqlite3_stmt *stmt;
-	int err = sqlite3_prepare_v2(this->sql, real_query.c_str(), real_query.length(), &stmt, NULL);
-	if (err != SQLITE_OK)
-		return SQLiteResult(query, real_query, sqlite3_errmsg(this->sql));
+	if (sqlite3_prepare_v2(this->sql, text.c_str(), text.length(), &stmt, NULL) != SQLITE_OK)
+		return NULL;
+
+	this->statements.push_front(std::make_pair(text, stmt));
+	this->statement_map[text] = this->statements.begin();
 
+	if (this->statements.size() > MaxStatements)
+	{
+		sqlite3_finalize(this->statements.back().second);
+		this->statement_map.erase(this->statements.back().first);
+		this->statements.pop_back();
+	}
+
+	return stmt;
+}
+
+SQLiteResult SQLiteService::Step(const Query &query, const Anope::string &real_query, sqlite3_stmt *stmt)
+{
 	std::vector<Anope::string> columns;
 	int cols = sqlite3_column_count(stmt);
 	columns.resize(cols);
@@ -166,6 +481,7 @@ Result SQLiteService::RunQuery(const Query &query)
 
 	SQLiteResult result(0, query, real_query);
 
+	int err;
 	while ((err = sqlite3_step(stmt)) == SQLITE_ROW)
 	{
 		std::map<Anope::string, Anope::string> items;
@@ -180,8 +496,6 @@ Result SQLiteService::RunQuery(const Query &query)
 
 	result.id = sqlite3_last_insert_rowid(this->sql);
 
-	sqlite3_finalize(stmt);
-
 	if (err != SQLITE_DONE)
 		return SQLiteResult(query, real_query, sqlite3_errmsg(this->sql));
 
@@ -232,7 +546,7 @@ std::vector<Query> SQLiteService::CreateTable(const Anope::string &table, const
 		query_text = "CREATE INDEX `" + table + "_timestamp_idx` ON `" + table + "` (`timestamp`)";
 		queries.push_back(query_text);
 
-		query_text = "CREATE TRIGGER `" + table + "_trigger` AFTER UPDATE ON `" + table + "` FOR EACH ROW BEGIN UPDATE `" + table + "` SET `timestamp` = CURRENT_TIMESTAMP WHERE `id` = `old.id`; end;";
+		query_text = "CREATE TRIGGER `" + table + "_trigger` AFTER UPDATE ON `" + table + "` FOR EACH ROW BEGIN UPDATE `" + table + "` SET `timestamp` = CURRENT_TIMESTAMP WHERE `id` = old.`id`; end;";
 		queries.push_back(query_text);
 	}
 	else
@@ -271,13 +585,15 @@ Query SQLiteService::BuildInsert(const Anope::string &table, unsigned int id, Da
 	query_text.erase(query_text.length() - 1);
 	query_text += ") VALUES (";
 	if (id > 0)
-		query_text += stringify(id) + ",";
+		query_text += "@id@,";
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 		query_text += "@" + it->first + "@,";
 	query_text.erase(query_text.length() - 1);
 	query_text += ")";
 
 	Query query(query_text);
+	if (id > 0)
+		query.SetValue("id", id);
 	for (Data::Map::const_iterator it = data.data.begin(), it_end = data.data.end(); it != it_end; ++it)
 	{
 		Anope::string buf;
@@ -288,6 +604,41 @@ Query SQLiteService::BuildInsert(const Anope::string &table, unsigned int id, Da
 	return query;
 }
 
+Query SQLiteService::BuildInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows)
+{
+	/* Every row needs the same columns, so columns missing from a row are emptied */
+	std::set<Anope::string> columns = this->active_schema[table];
+	columns.erase("id");
+	columns.erase("timestamp");
+	for (unsigned i = 0; i < rows.size(); ++i)
+		for (Data::Map::const_iterator it = rows[i].second->data.begin(), it_end = rows[i].second->data.end(); it != it_end; ++it)
+			columns.insert(it->first);
+
+	Query query;
+	Anope::string query_text = "REPLACE INTO `" + table + "` (`id`";
+	for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it)
+		query_text += ",`" + *it + "`";
+	query_text += ") VALUES ";
+	for (unsigned i = 0; i < rows.size(); ++i)
+	{
+		query_text += (i ? ",(@" : "(@") + stringify(i) + ":id@";
+		query.SetValue(stringify(i) + ":id", rows[i].first);
+		for (std::set<Anope::string>::const_iterator it = columns.begin(), it_end = columns.end(); it != it_end; ++it)
+		{
+			Anope::string key = stringify(i) + ":" + *it, buf;
+			Data::Map::const_iterator col = rows[i].second->data.find(*it);
+			if (col != rows[i].second->data.end())
+				*col->second >> buf;
+
+			query_text += ",@" + key + "@";
+			query.SetValue(key, buf);
+		}
+		query_text += ")";
+	}
+	query.query = query_text;
+	return query;
+}
+
 Query SQLiteService::GetTables(const Anope::string &prefix)
 {
 	return Query("SELECT name FROM sqlite_master WHERE type='table' AND name LIKE '" + prefix + "%';");
@@ -303,12 +654,9 @@ Anope::string SQLiteService::Escape(const Anope::string &query)
 
 Anope::string SQLiteService::BuildQuery(const Query &q)
 {
-	Anope::string real_query = q.query;
-
-	for (std::map<Anope::string, QueryData>::const_iterator it = q.parameters.begin(), it_end = q.parameters.end(); it != it_end; ++it)
-		real_query = real_query.replace_all_cs("@" + it->first + "@", (it->second.escape ? ("'" + this->Escape(it->second.data) + "'") : it->second.data));
-
-	return real_query;
+	QueryText<SQLiteService> real_query(this);
+	real_query.Visit(q);
+	return real_query.text;
 }
 
 Anope::string SQLiteService::FromUnixtime(time_t t)
@@ -316,5 +664,46 @@ Anope::string SQLiteService::FromUnixtime(time_t t)
 	return "datetime('" + stringify(t) + "', 'unixepoch')";
 }
 
+void DispatchTask::Run()
+{
+	me->QueryLock.Lock();
+
+	while (!service->QueryRequests.empty())
+	{
+		/* Take every request waiting for the database, up to MaxBatch, to execute together */
+		std::deque<QueryRequest> requests;
+		while (!service->QueryRequests.empty() && requests.size() < MaxBatch)
+		{
+			requests.push_back(service->QueryRequests.front());
+			service->QueryRequests.pop_front();
+		}
+		me->QueryLock.Unlock();
+
+		std::deque<QueryResult> results;
+		service->Lock.Lock();
+		service->Execute(requests, results);
+		service->Lock.Unlock();
+
+		me->QueryLock.Lock();
+		me->FinishedRequests.insert(me->FinishedRequests.end(), results.begin(), results.end());
+		if (!me->FinishedRequests.empty())
+			CompletionQueue::Post(me);
+	}
+
+	me->QueryLock.Unlock();
+}
+
+void DispatchTask::OnComplete()
+{
+	/* Requests made after the task last checked the queue are still waiting */
+	me->QueryLock.Lock();
+	bool pending = !service->QueryRequests.empty();
+	me->QueryLock.Unlock();
+
+	this->submitted = pending;
+	if (pending)
+		ThreadPool::Submit(this);
+}
+
 MODULE_INIT(ModuleSQLite)
 
@@ -48,6 +48,15 @@ class SSLSocketIO : public SocketIO
 	 */
 	int Send(Socket *s, const char *buf, size_t sz) anope_override;
 
+	/** Write several buffers to the socket, one SSL record at a time
+	 * @param s The socket
+	 * @param bufs The buffers to write, in order
+	 * @param lens The length of each buffer
+	 * @param count The number of buffers
+	 * @return Number of bytes written
+	 */
+	int Send(Socket *s, const char * const *bufs, const size_t *lens, int count) anope_override;
+
 	/** Accept a connection from a socket
 	 * @param s The socket
 	 * @return The new socket
@@ -163,10 +172,11 @@ class SSLModule : public Module
 
 	~SSLModule()
 	{
-		for (std::map<int, Socket *>::const_iterator it = SocketEngine::Sockets.begin(), it_end = SocketEngine::Sockets.end(); it != it_end;)
+		for (unsigned i = 0; i < SocketEngine::Sockets.size(); ++i)
 		{
-			Socket *s = it->second;
-			++it;
+			Socket *s = SocketEngine::Sockets[i];
+			if (s == NULL)
+				continue;
 
 			if (dynamic_cast<SSLSocketIO *>(s->io))
 				delete s;
@@ -226,6 +236,21 @@ int SSLSocketIO::Send(Socket *s, const char *buf, size_t sz)
 	return i;
 }
 
+int SSLSocketIO::Send(Socket *s, const char * const *bufs, const size_t *lens, int count)
+{
+	int total = 0;
+	for (int j = 0; j < count; ++j)
+	{
+		int i = this->Send(s, bufs[j], lens[j]);
+		if (i <= 0)
+			return total ? total : i;
+		total += i;
+		if (static_cast<size_t>(i) != lens[j])
+			break;
+	}
+	return total;
+}
+
 ClientSocket *SSLSocketIO::Accept(ListenSocket *s)
 {
 	if (s->io == &NormalSocketIO)
@@ -133,6 +133,113 @@ namespace SQL
 		}
 	};
 
+	/** Walks the text of a query, replacing each @name@ that is a parameter of it in one pass,
+	 * so the values substituted in are never searched for other names
+	 */
+	class QueryVisitor
+	{
+	 public:
+		virtual ~QueryVisitor() { }
+
+		/** Called for the text between parameters, including any @ that doesn't start one
+		 */
+		virtual void OnText(const Anope::string &text) = 0;
+
+		/** Called for each parameter, in the order they appear in the query
+		 */
+		virtual void OnParameter(const QueryData &data) = 0;
+
+		void Visit(const Query &q)
+		{
+			for (size_t pos = 0; pos < q.query.length();)
+			{
+				size_t start = q.query.find('@', pos), end = start == Anope::string::npos ? start : q.query.find('@', start + 1);
+				if (end == Anope::string::npos)
+				{
+					this->OnText(q.query.substr(pos));
+					break;
+				}
+
+				std::map<Anope::string, QueryData>::const_iterator it = q.parameters.find(q.query.substr(start + 1, end - start - 1));
+				if (it == q.parameters.end())
+				{
+					this->OnText(q.query.substr(pos, start + 1 - pos));
+					pos = start + 1;
+					continue;
+				}
+
+				if (start > pos)
+					this->OnText(q.query.substr(pos, start - pos));
+				this->OnParameter(it->second);
+				pos = end + 1;
+			}
+		}
+	};
+
+	/** The text of a query to run as is, with each escaped parameter quoted and escaped by the provider T
+	 */
+	template<typename T> class QueryText : public QueryVisitor
+	{
+		T *provider;
+	 public:
+		Anope::string text;
+
+		QueryText(T *p) : provider(p) { }
+
+		void OnText(const Anope::string &t) anope_override
+		{
+			this->text += t;
+		}
+
+		void OnParameter(const QueryData &data) anope_override
+		{
+			this->text += data.escape ? ("'" + this->provider->Escape(data.data) + "'") : data.data;
+		}
+	};
+
+	/** A query with a ? in place of each escaped parameter, so a statement prepared from the
+	 * text can be kept and run again for every query of the same shape, with different values
+	 * bound to it. Unescaped parameters are part of the text.
+	 */
+	struct PreparedQuery : QueryVisitor
+	{
+		Anope::string text;
+		/* The values to bind, in the order of the ?s */
+		std::vector<const Anope::string *> values;
+
+		/** Builds the text of a query
+		 * @return false if the query has no values to bind or already contains a ?, in which case it should be run as is
+		 */
+		bool Build(const Query &q)
+		{
+			this->text.clear();
+			this->values.clear();
+
+			if (q.parameters.empty() || q.query.find('?') != Anope::string::npos)
+				return false;
+
+			this->Visit(q);
+
+			return !this->values.empty();
+		}
+
+		void OnText(const Anope::string &t) anope_override
+		{
+			this->text += t;
+		}
+
+		void OnParameter(const QueryData &data) anope_override
+		{
+			if (data.escape)
+			{
+				this->text += "?";
+				this->values.push_back(&data.data);
+			}
+			else
+				this->text += data.data;
+		}
+	};
+
 	/** A result from a SQL query
 	 */
 	class Result
@@ -210,6 +317,12 @@ namespace SQL
 
 		virtual Query BuildInsert(const Anope::string &table, unsigned int id, Data &data) = 0;
 
+		/** Builds a query inserting or replacing many rows of a table at once
+		 * @param table The table
+		 * @param rows The id and data of each row. The ids must already be known, as only the last id inserted is returned.
+		 */
+		virtual Query BuildInsert(const Anope::string &table, const std::vector<std::pair<unsigned int, Data *> > &rows) = 0;
+
 		virtual Query GetTables(const Anope::string &prefix) = 0;
 
 		virtual Anope::string FromUnixtime(time_t) = 0;
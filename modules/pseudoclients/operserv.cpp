@@ -61,20 +61,21 @@ class SGLineManager : public XLineManager
 			return false;
 		}
 
-		if (!x->GetNick().empty() && !Anope::Match(u->nick, x->GetNick()))
+		if (!x->compiled_nick.GetMask().empty() && !x->compiled_nick.Matches(u->nick))
 			return false;
 
-		if (!x->GetUser().empty() && !Anope::Match(u->GetIdent(), x->GetUser()))
+		if (!x->compiled_user.GetMask().empty() && !x->compiled_user.Matches(u->GetIdent()))
 			return false;
 
-		if (!x->GetReal().empty() && !Anope::Match(u->realname, x->GetReal()))
+		if (!x->compiled_real.GetMask().empty() && !x->compiled_real.Matches(u->realname))
 			return false;
 
-		if (!x->GetHost().empty())
+		const Anope::string &host = x->compiled_host.GetMask();
+		if (!host.empty())
 		{
 			try
 			{
-				cidr cidr_ip(x->GetHost());
+				cidr cidr_ip(host);
 				sockaddrs ip(u->ip);
 				if (cidr_ip.match(ip))
 					return true;
@@ -82,11 +83,16 @@ class SGLineManager : public XLineManager
 			catch (const SocketException &) { }
 		}
 
-		if (x->GetHost().empty() || Anope::Match(u->host, x->GetHost()))
+		if (host.empty() || x->compiled_host.Matches(u->host))
 			return true;
 
 		return false;
 	}
+
+	bool IsHostBased() const anope_override
+	{
+		return true;
+	}
 };
 
 class SQLineManager : public XLineManager
@@ -118,14 +124,17 @@ class SQLineManager : public XLineManager
 	{
 		if (x->regex)
 			return x->regex->Matches(u->nick);
-		return Anope::Match(u->nick, x->mask);
+		return x->compiled_mask.Matches(u->nick);
 	}
 
 	bool CheckChannel(Channel *c)
 	{
 		for (std::vector<XLine *>::const_iterator it = this->GetList().begin(), it_end = this->GetList().end(); it != it_end; ++it)
-			if (Anope::Match(c->name, (*it)->mask, false, true))
+		{
+			const XLine *x = *it;
+			if (x->regex ? x->regex->Matches(c->name) : x->compiled_mask.Matches(c->name))
 				return true;
+		}
 		return false;
 	}
 };
@@ -159,7 +168,7 @@ class SNLineManager : public XLineManager
 	{
 		if (x->regex)
 			return x->regex->Matches(u->realname);
-		return Anope::Match(u->realname, x->mask, false, true);
+		return x->compiled_mask.Matches(u->realname);
 	}
 };
 
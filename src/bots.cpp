@@ -22,7 +22,7 @@
 Serialize::Checker<botinfo_map> BotListByNick("BotInfo"), BotListByUID("BotInfo");
 
 static const Anope::string BotFlagString[] = { "BEGIN", "CORE", "PRIVATE", "CONF", "" };
-template<> const Anope::string* Flags<BotFlag>::flags_strings = BotFlagString;
+template<> const Anope::string* Flags<BotFlag, BI_END>::flags_strings = BotFlagString;
 
 static const Anope::string BotServFlagStrings[] = {
 	"BEGIN", "DONTKICKOPS", "DONTKICKVOICES", "FANTASY", "GREET", "NOBOT",
@@ -30,7 +30,7 @@ static const Anope::string BotServFlagStrings[] = {
 	"KICK_FLOOD", "KICK_REPEAT", "KICK_ITALICS", "KICK_AMSGS", "MSG_PRIVMSG", "MSG_NOTICE",
 	"MSG_NOTICEOPS", ""
 };
-template<> const Anope::string* Flags<BotServFlag>::flags_strings = BotServFlagStrings;
+template<> const Anope::string* Flags<BotServFlag, BS_END>::flags_strings = BotServFlagStrings;
 
 BotInfo *BotServ = NULL, *ChanServ = NULL, *Global = NULL, *HostServ = NULL, *MemoServ = NULL, *NickServ = NULL, *OperServ = NULL;
 
@@ -191,10 +191,12 @@ UserContainer* Channel::JoinUser(User *user)
 	ChannelContainer *cc = new ChannelContainer(this);
 	cc->status = status;
 	user->chans.push_back(cc);
+	user->chans_index[this] = --user->chans.end();
 
 	UserContainer *uc = new UserContainer(user);
 	uc->status = status;
 	this->users.push_back(uc);
+	this->users_index[user] = --this->users.end();
 
 	if (this->ci && this->ci->HasFlag(CI_PERSIST) && this->creation_time > this->ci->time_registered)
 	{
@@ -212,26 +214,26 @@ void Channel::DeleteUser(User *user)
 	Log(user, this, "leaves");
 	FOREACH_MOD(I_OnLeaveChannel, OnLeaveChannel(user, this));
 
-	CUserList::iterator cit, cit_end = this->users.end();
-	for (cit = this->users.begin(); (*cit)->user != user && cit != cit_end; ++cit);
-	if (cit == cit_end)
+	CUserIndex::iterator cit = this->users_index.find(user);
+	if (cit == this->users_index.end())
 	{
 		Log(LOG_DEBUG) << "Channel::DeleteUser() tried to delete nonexistant user " << user->nick << " from channel " << this->name;
 		return;
 	}
 
-	delete (*cit)->status;
-	delete *cit;
-	this->users.erase(cit);
+	delete (*cit->second)->status;
+	delete *cit->second;
+	this->users.erase(cit->second);
+	this->users_index.erase(cit);
 
-	UChannelList::iterator uit, uit_end = user->chans.end();
-	for (uit = user->chans.begin(); (*uit)->chan != this && uit != uit_end; ++uit);
-	if (uit == uit_end)
+	UChannelIndex::iterator uit = user->chans_index.find(this);
+	if (uit == user->chans_index.end())
 		Log(LOG_DEBUG) << "Channel::DeleteUser() tried to delete nonexistant channel " << this->name << " from " << user->nick << "'s channel list";
 	else
 	{
-		delete *uit;
-		user->chans.erase(uit);
+		delete *uit->second;
+		user->chans.erase(uit->second);
+		user->chans_index.erase(uit);
 	}
 
 	/* Channel is persistent, it shouldn't be deleted and the service bot should stay */
@@ -254,9 +256,9 @@ void Channel::DeleteUser(User *user)
 
 UserContainer *Channel::FindUser(const User *u) const
 {
-	for (CUserList::const_iterator it = this->users.begin(), it_end = this->users.end(); it != it_end; ++it)
-		if ((*it)->user == u)
-			return *it;
+	CUserIndex::const_iterator it = this->users_index.find(u);
+	if (it != this->users_index.end())
+		return *it->second;
 	return NULL;
 }
 
@@ -265,7 +267,6 @@ bool Channel::HasUserStatus(const User *u, ChannelModeStatus *cms) const
 	if (!u || (cms && cms->type != MODE_STATUS))
 		throw CoreException("Channel::HasUserStatus got bad mode");
 
-	/* Usually its more efficient to search the users channels than the channels users */
 	ChannelContainer *cc = u->FindChannel(this);
 	if (cc)
 	{
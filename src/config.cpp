@@ -189,6 +189,7 @@ ServerConfig::ServerConfig()
 			Log() << "Unknown casemap " << this->CaseMap << " - casemap not changed";
 		}
 	}
+	Anope::RebuildCaseMap();
 
 	if (this->SessionIPv4CIDR > 32 || this->SessionIPv6CIDR > 128)
 		throw ConfigException("Session CIDR value out of range");
@@ -1161,6 +1162,8 @@ ConfigItems::ConfigItems(ServerConfig *conf)
 		{"options", "updatetimeout", "0", new ValueContainerTime(&conf->UpdateTimeout), DT_TIME, ValidateNotZero},
 		{"options", "expiretimeout", "0", new ValueContainerTime(&conf->ExpireTimeout), DT_TIME, ValidateNotZero},
 		{"options", "readtimeout", "0", new ValueContainerTime(&conf->ReadTimeout), DT_TIME, ValidateNotZero},
+		{"options", "edgetriggered", "no", new ValueContainerBool(&conf->EdgeTriggered), DT_BOOLEAN, NoValidation},
+		{"options", "threads", "4", new ValueContainerUInt(&conf->MaxThreads), DT_UINTEGER, NoValidation},
 		{"options", "warningtimeout", "0", new ValueContainerTime(&conf->WarningTimeout), DT_TIME, ValidateNotZero},
 		{"options", "timeoutcheck", "0", new ValueContainerTime(&conf->TimeoutCheck), DT_TIME, NoValidation},
 		{"options", "keepbackups", "0", new ValueContainerInt(&conf->KeepBackups), DT_INTEGER, NoValidation},
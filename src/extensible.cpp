@@ -0,0 +1,40 @@
+/*
+ *
+ * (C) 2003-2012 Anope Team
+ * Contact us at team@anope.org
+ *
+ * Please read COPYING and README for further details.
+ *
+ */
+
+#include "services.h"
+#include "extensible.h"
+
+/* The slot of each registered key, and the name of each slot. Key names are case sensitive. */
+typedef std::tr1::unordered_map<std::string, unsigned> key_slot_map;
+static key_slot_map *key_slots;
+static std::vector<Anope::string> *key_names;
+
+ExtensibleKey::ExtensibleKey(const Anope::string &name)
+{
+	if (!key_slots)
+	{
+		key_slots = new key_slot_map();
+		key_names = new std::vector<Anope::string>();
+	}
+
+	key_slot_map::iterator it = key_slots->find(name.str());
+	if (it != key_slots->end())
+		this->slot = it->second;
+	else
+	{
+		this->slot = key_names->size();
+		key_names->push_back(name);
+		key_slots->insert(std::make_pair(name.str(), this->slot));
+	}
+}
+
+const Anope::string &ExtensibleKey::GetName(unsigned slot)
+{
+	return (*key_names)[slot];
+}
@@ -19,6 +19,7 @@
 #include "socketengine.h"
 #include "servers.h"
 #include "language.h"
+#include "threadengine.h"
 
 #ifndef _WIN32
 #include <sys/wait.h>
@@ -356,6 +357,7 @@ void Anope::Init(int ac, char **av)
 
 	/* Initialize the socket engine */
 	SocketEngine::Init();
+	CompletionQueue::Init();
 
 	/* Read configuration file; exit if there are problems. */
 	try
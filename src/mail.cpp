@@ -14,7 +14,7 @@
 #include "mail.h"
 #include "config.h"
 
-Mail::Message::Message(const Anope::string &sf, const Anope::string &mailto, const Anope::string &a, const Anope::string &s, const Anope::string &m) : Thread(), sendmail_path(Config->SendMailPath), send_from(sf), mail_to(mailto), addr(a), subject(s), message(m), dont_quote_addresses(Config->DontQuoteAddresses), success(false)
+Mail::Message::Message(const Anope::string &sf, const Anope::string &mailto, const Anope::string &a, const Anope::string &s, const Anope::string &m) : Task(), sendmail_path(Config->SendMailPath), send_from(sf), mail_to(mailto), addr(a), subject(s), message(m), dont_quote_addresses(Config->DontQuoteAddresses), success(false)
 {
 }
 
@@ -31,10 +31,7 @@ void Mail::Message::Run()
 	FILE *pipe = popen(sendmail_path.c_str(), "w");
 
 	if (!pipe)
-	{
-		SetExitState();
 		return;
-	}
 
 	fprintf(pipe, "From: %s\n", send_from.c_str());
 	if (this->dont_quote_addresses)
@@ -48,7 +45,6 @@ void Mail::Message::Run()
 	pclose(pipe);
 
 	success = true;
-	SetExitState();
 }
 
 bool Mail::Send(User *u, NickCore *nc, const BotInfo *service, const Anope::string &subject, const Anope::string &message)
@@ -64,8 +60,7 @@ bool Mail::Send(User *u, NickCore *nc, const BotInfo *service, const Anope::stri
 			return false;
 
 		nc->lastmail = Anope::CurTime;
-		Thread *t = new Mail::Message(Config->SendFrom, nc->display, nc->email, subject, message);
-		t->Start();
+		ThreadPool::Submit(new Mail::Message(Config->SendFrom, nc->display, nc->email, subject, message));
 		return true;
 	}
 	else
@@ -79,8 +74,7 @@ bool Mail::Send(User *u, NickCore *nc, const BotInfo *service, const Anope::stri
 		else
 		{
 			u->lastmail = nc->lastmail = Anope::CurTime;
-			Thread *t = new Mail::Message(Config->SendFrom, nc->display, nc->email, subject, message);
-			t->Start();
+			ThreadPool::Submit(new Mail::Message(Config->SendFrom, nc->display, nc->email, subject, message));
 			return true;
 		}
 
@@ -94,8 +88,7 @@ bool Mail::Send(NickCore *nc, const Anope::string &subject, const Anope::string
 		return false;
 
 	nc->lastmail = Anope::CurTime;
-	Thread *t = new Mail::Message(Config->SendFrom, nc->display, nc->email, subject, message);
-	t->Start();
+	ThreadPool::Submit(new Mail::Message(Config->SendFrom, nc->display, nc->email, subject, message));
 
 	return true;
 }
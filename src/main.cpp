@@ -16,6 +16,7 @@
 #include "bots.h"
 #include "socketengine.h"
 #include "uplink.h"
+#include "threadengine.h"
 
 #ifndef _WIN32
 #include <limits.h>
@@ -153,6 +154,9 @@ int main(int ac, char **av, char **envp)
 	{
 		Log(LOG_DEBUG_2) << "Top of main loop";
 
+		/* Updates queued from now on are passed on to the database modules again */
+		Serializable::NextGeneration();
+
 		/* Process timers */
 		if (Anope::CurTime - last_check >= Config->TimeoutCheck)
 		{
@@ -160,6 +164,10 @@ int main(int ac, char **av, char **envp)
 			last_check = Anope::CurTime;
 		}
 
+		/* Send everything queued for the uplink during this iteration before waiting for more */
+		if (UplinkSock)
+			UplinkSock->Flush();
+
 		/* Process the socket engine */
 		SocketEngine::Process();
 
@@ -183,6 +191,7 @@ int main(int ac, char **av, char **envp)
 	delete UplinkSock;
 
 	ModuleManager::UnloadAll();
+	ThreadPool::Shutdown();
 	SocketEngine::Shutdown();
 	for (Module *m; (m = ModuleManager::FindFirstOf(PROTOCOL)) != NULL;)
 		ModuleManager::UnloadModule(m, NULL);
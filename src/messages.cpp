@@ -72,6 +72,7 @@ void Join::Run(MessageSource &source, const std::vector<Anope::string> &params)
 				FOREACH_MOD(I_OnPartChannel, OnPartChannel(user, Channel::Find(channame), channame, ""));
 			}
 			user->chans.clear();
+			user->chans_index.clear();
 			continue;
 		}
 
@@ -350,6 +351,7 @@ void Quit::Run(MessageSource &source, const std::vector<Anope::string> &params)
 	{
 		na->last_seen = Anope::CurTime;
 		na->last_quit = reason;
+		na->QueueUpdate();
 	}
 	FOREACH_MOD(I_OnUserQuit, OnUserQuit(user, reason));
 	delete user;
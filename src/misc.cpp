@@ -227,6 +227,16 @@ bool Anope::IsFile(const Anope::string &filename)
 	return false;
 }
 
+bool Anope::ReplaceFile(const Anope::string &from, const Anope::string &to)
+{
+#ifdef _WIN32
+	/* rename() won't replace a file which exists on Windows */
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return !rename(from.c_str(), to.c_str());
+#endif
+}
+
 time_t Anope::DoTime(const Anope::string &s)
 {
 	if (s.empty())
@@ -347,59 +357,113 @@ Anope::string Anope::Expires(time_t expires, const NickCore *nc)
 	}
 }
 
-bool Anope::Match(const Anope::string &str, const Anope::string &mask, bool case_sensitive, bool use_regex)
+/* tolower() of every character, so matching does not need a call per character */
+static struct LowerTable
 {
-	size_t s = 0, m = 0, str_len = str.length(), mask_len = mask.length();
+	unsigned char table[256];
+	/* Whether a lowercase character is the only one which lowercases to itself */
+	bool unique[256];
 
-	if (use_regex && mask_len >= 2 && mask[0] == '/' && mask[mask.length() - 1] == '/')
+	LowerTable()
 	{
-		Anope::string stripped_mask = mask.substr(1, mask_len - 2);
-		// This is often called with the same mask multiple times in a row, so cache it
-		static Regex *r = NULL;
+		unsigned char count[256] = { 0 };
 
-		if (r == NULL || r->GetExpression() != stripped_mask)
+		for (unsigned i = 0; i < 256; ++i)
 		{
-			ServiceReference<RegexProvider> provider("Regex", Config->RegexEngine);
-			if (provider)
-			{
-				try
-				{
-					delete r;
-					r = NULL;
-					// This may throw
-					r = provider->Compile(stripped_mask);
-				}
-				catch (const RegexException &ex)
-				{
-					Log(LOG_DEBUG) << ex.GetReason();
-				}
-			}
-			else
-			{
-				delete r;
-				r = NULL;
-			}
+			table[i] = tolower(i);
+			++count[table[i]];
 		}
 
-		if (r != NULL && r->Matches(str))
-			return true;
+		for (unsigned i = 0; i < 256; ++i)
+			unique[i] = count[i] == 1;
+	}
 
-		// Fall through to non regex match
+	inline char operator()(char c) const
+	{
+		return table[static_cast<unsigned char>(c)];
+	}
+} lower_table;
+
+/* Regexes compiled for Anope::Match, most recently used first */
+typedef std::list<std::pair<Anope::string, Regex *> > regex_list;
+static regex_list regex_cache_list;
+static std::map<Anope::string, regex_list::iterator> regex_cache;
+/* What the cached regexes were compiled with */
+static Anope::string regex_cache_engine;
+static unsigned regex_cache_generation;
+
+Regex *RegexCache::Find(const Anope::string &expression)
+{
+	/* Regexes which failed to compile are cached too, so start over if the regex engine may have changed */
+	if (regex_cache_engine != Config->RegexEngine || regex_cache_generation != Service::GetGeneration())
+	{
+		Clear();
+		regex_cache_engine = Config->RegexEngine;
+		regex_cache_generation = Service::GetGeneration();
+	}
+
+	std::map<Anope::string, regex_list::iterator>::iterator it = regex_cache.find(expression);
+	if (it != regex_cache.end())
+	{
+		regex_cache_list.splice(regex_cache_list.begin(), regex_cache_list, it->second);
+		return it->second->second;
 	}
 
-	while (s < str_len && m < mask_len && mask[m] != '*')
+	Regex *r = NULL;
+	ServiceReference<RegexProvider> provider("Regex", Config->RegexEngine);
+	if (provider)
 	{
-		char string = str[s], wild = mask[m];
-		if (case_sensitive)
+		try
 		{
-			if (wild != string && wild != '?')
-				return false;
+			r = provider->Compile(expression);
 		}
-		else
+		catch (const RegexException &ex)
 		{
-			if (tolower(wild) != tolower(string) && wild != '?')
-				return false;
+			Log(LOG_DEBUG) << ex.GetReason();
 		}
+	}
+
+	if (regex_cache_list.size() >= MaxSize)
+	{
+		delete regex_cache_list.back().second;
+		regex_cache.erase(regex_cache_list.back().first);
+		regex_cache_list.pop_back();
+	}
+
+	regex_cache_list.push_front(std::make_pair(expression, r));
+	regex_cache[expression] = regex_cache_list.begin();
+
+	return r;
+}
+
+void RegexCache::Clear()
+{
+	for (regex_list::iterator it = regex_cache_list.begin(), it_end = regex_cache_list.end(); it != it_end; ++it)
+		delete it->second;
+	regex_cache_list.clear();
+	regex_cache.clear();
+}
+
+bool Anope::Match(const Anope::string &str, const Anope::string &mask, bool case_sensitive, bool use_regex)
+{
+	size_t s = 0, m = 0, str_len = str.length(), mask_len = mask.length();
+
+	if (use_regex && mask_len >= 2 && mask[0] == '/' && mask[mask.length() - 1] == '/')
+	{
+		Regex *r = RegexCache::Find(mask.substr(1, mask_len - 2));
+		if (r != NULL && r->Matches(str))
+			return true;
+
+		// Fall through to non regex match
+	}
+
+	const char *sp_str = str.c_str(), *mp_str = mask.c_str();
+
+	while (s < str_len && m < mask_len && mp_str[m] != '*')
+	{
+		char string = sp_str[s], wild = mp_str[m];
+		if (wild != '?' && (case_sensitive ? wild != string : lower_table(wild) != lower_table(string)))
+			return false;
 
 		++m;
 		++s;
@@ -408,7 +472,7 @@ bool Anope::Match(const Anope::string &str, const Anope::string &mask, bool case
 	size_t sp = Anope::string::npos, mp = Anope::string::npos;
 	while (s < str_len)
 	{
-		char string = str[s], wild = mask[m];
+		char string = sp_str[s], wild = mp_str[m];
 		if (wild == '*')
 		{
 			if (++m == mask_len)
@@ -417,40 +481,182 @@ bool Anope::Match(const Anope::string &str, const Anope::string &mask, bool case
 			mp = m;
 			sp = s + 1;
 		}
-		else if (case_sensitive)
+		else if (wild == '?' || (case_sensitive ? wild == string : lower_table(wild) == lower_table(string)))
 		{
-			if (wild == string || wild == '?')
-			{
-				++m;
-				++s;
-			}
-			else
-			{
-				m = mp;
-				s = sp++;
-			}
+			++m;
+			++s;
 		}
 		else
 		{
-			if (tolower(wild) == tolower(string) || wild == '?')
-			{
-				++m;
-				++s;
-			}
-			else
-			{
-				m = mp;
-				s = sp++;
-			}
+			m = mp;
+			s = sp++;
 		}
 	}
 
-	if (m < mask_len && mask[m] == '*')
+	while (m < mask_len && mp_str[m] == '*')
 		++m;
 
 	return m == mask_len;
 }
 
+/** Compares part of a string to a segment of a compiled mask
+ * @param str The string
+ * @param seg The segment, lowercased if not case sensitive
+ * @param len The length of the segment
+ * @param case_sensitive Whether the comparison is case sensitive
+ * @param wild Whether the segment contains a '?'
+ * @return true if they are equal
+ */
+static inline bool SegmentEquals(const char *str, const char *seg, size_t len, bool case_sensitive, bool wild)
+{
+	if (case_sensitive && !wild)
+		return !memcmp(str, seg, len);
+
+	for (size_t i = 0; i < len; ++i)
+	{
+		char c = seg[i];
+		if (wild && c == '?')
+			continue;
+		if ((case_sensitive ? str[i] : lower_table(str[i])) != c)
+			return false;
+	}
+
+	return true;
+}
+
+/** Finds the first occurrence of a segment of a compiled mask in a string
+ * @param str The start of the string
+ * @param end The end of the string
+ * @param seg The segment, lowercased if not case sensitive
+ * @param len The length of the segment
+ * @param case_sensitive Whether the search is case sensitive
+ * @param wild Whether the segment contains a '?'
+ * @return Where the segment starts, or NULL if it was not found
+ */
+static const char *FindSegment(const char *str, const char *end, const char *seg, size_t len, bool case_sensitive, bool wild)
+{
+	if (static_cast<size_t>(end - str) < len)
+		return NULL;
+
+	const char *last = end - len;
+	char first = seg[0];
+
+	if (first != '?' && (case_sensitive || lower_table.unique[static_cast<unsigned char>(first)]))
+	{
+		/* The first character can only match itself, so memchr can skip to each place it might start */
+		for (const char *p = str; p <= last && (p = static_cast<const char *>(memchr(p, first, last - p + 1))) != NULL; ++p)
+			if (SegmentEquals(p + 1, seg + 1, len - 1, case_sensitive, wild))
+				return p;
+		return NULL;
+	}
+
+	for (const char *p = str; p <= last; ++p)
+		if (SegmentEquals(p, seg, len, case_sensitive, wild))
+			return p;
+	return NULL;
+}
+
+Anope::CompiledMask::CompiledMask() : case_sensitive(false), use_regex(false), is_regex(false), star_start(false), star_end(false)
+{
+}
+
+Anope::CompiledMask::CompiledMask(const Anope::string &m, bool cs, bool ur)
+{
+	this->Compile(m, cs, ur);
+}
+
+void Anope::CompiledMask::Compile(const Anope::string &m, bool cs, bool ur)
+{
+	this->mask = m;
+	this->case_sensitive = cs;
+	this->use_regex = ur;
+	this->is_regex = ur && m.length() >= 2 && m[0] == '/' && m[m.length() - 1] == '/';
+	this->expression = this->is_regex ? m.substr(1, m.length() - 2) : "";
+
+	/* Regexes fall back to matching the whole mask as a glob if they fail, so always compile that */
+	this->pattern = m;
+	if (!cs)
+		for (size_t i = 0; i < this->pattern.length(); ++i)
+			this->pattern[i] = lower_table(this->pattern[i]);
+
+	this->star_start = !m.empty() && m[0] == '*';
+	this->star_end = !m.empty() && m[m.length() - 1] == '*';
+
+	this->segments.clear();
+	for (size_t pos = 0; pos < this->pattern.length();)
+	{
+		size_t star = this->pattern.find('*', pos);
+		if (star == Anope::string::npos)
+			star = this->pattern.length();
+
+		if (star > pos)
+		{
+			Segment seg;
+			seg.offset = pos;
+			seg.length = star - pos;
+			seg.wild = memchr(this->pattern.c_str() + pos, '?', seg.length) != NULL;
+			this->segments.push_back(seg);
+		}
+
+		pos = star + 1;
+	}
+}
+
+const Anope::string &Anope::CompiledMask::GetMask() const
+{
+	return this->mask;
+}
+
+bool Anope::CompiledMask::Matches(const Anope::string &str) const
+{
+	if (this->is_regex)
+	{
+		Regex *r = RegexCache::Find(this->expression);
+		if (r != NULL && r->Matches(str))
+			return true;
+	}
+
+	const char *p = this->pattern.c_str(), *s = str.c_str(), *end = s + str.length();
+
+	if (this->segments.empty())
+		/* The mask is empty or only '*'s */
+		return this->star_start || s == end;
+
+	size_t first = 0, last = this->segments.size();
+
+	if (!this->star_start)
+	{
+		const Segment &seg = this->segments[first++];
+		if (static_cast<size_t>(end - s) < seg.length || !SegmentEquals(s, p + seg.offset, seg.length, this->case_sensitive, seg.wild))
+			return false;
+		s += seg.length;
+
+		if (first == last && !this->star_end)
+			/* There is no '*' at all, so the whole string must have been matched */
+			return s == end;
+	}
+
+	if (!this->star_end && first < last)
+	{
+		const Segment &seg = this->segments[--last];
+		if (static_cast<size_t>(end - s) < seg.length || !SegmentEquals(end - seg.length, p + seg.offset, seg.length, this->case_sensitive, seg.wild))
+			return false;
+		end -= seg.length;
+	}
+
+	/* The segments between '*'s can match anywhere, so take the first place each one fits */
+	for (size_t i = first; i < last; ++i)
+	{
+		const Segment &seg = this->segments[i];
+		const char *found = FindSegment(s, end, p + seg.offset, seg.length, this->case_sensitive, seg.wild);
+		if (found == NULL)
+			return false;
+		s = found + seg.length;
+	}
+
+	return true;
+}
+
 void Anope::Encrypt(const Anope::string &src, Anope::string &dest)
 {
 	EventReturn MOD_RESULT;
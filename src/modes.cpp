@@ -42,7 +42,7 @@ static const Anope::string UserModeNameStrings[] = {
 
 	""
 };
-template<> const Anope::string* Flags<UserModeName>::flags_strings = UserModeNameStrings;
+template<> const Anope::string* Flags<UserModeName, UMODE_END * 2>::flags_strings = UserModeNameStrings;
 
 static const Anope::string ChannelModeNameStrings[] = {
 	"CMODE_BEGIN",
@@ -65,7 +65,7 @@ static const Anope::string ChannelModeNameStrings[] = {
 
 	""
 };
-template<> const Anope::string* Flags<ChannelModeName>::flags_strings = ChannelModeNameStrings;
+template<> const Anope::string* Flags<ChannelModeName, CMODE_END * 2>::flags_strings = ChannelModeNameStrings;
 
 static const Anope::string EntryFlagString[] = { "ENTRYTYPE_NONE", "ENTRYTYPE_CIDR", "ENTRYTYPE_NICK_WILD", "ENTRYTYPE_NICK", "ENTRYTYPE_USER_WILD", "ENTRYTYPE_USER", "ENTRYTYPE_HOST_WILD", "ENTRYTYPE_HOST", "" };
 template<> const Anope::string* Flags<EntryType>::flags_strings = EntryFlagString;
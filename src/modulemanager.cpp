@@ -11,6 +11,7 @@
 #include "modules.h"
 #include "users.h"
 #include "regchannel.h"
+#include "regexpr.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -306,6 +307,9 @@ ModuleReturn ModuleManager::DeleteModule(Module *m)
 	else
 		destroy_func(m); /* Let the module delete it self, just in case */
 
+	/* The cached regexes may have been compiled by this module */
+	RegexCache::Clear();
+
 	if (dlclose(handle))
 		Log() << dlerror();
 
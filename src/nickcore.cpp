@@ -20,14 +20,14 @@ Serialize::Checker<nickcore_map> NickCoreList("NickCore");
 static const Anope::string NickNameFlagStrings[] = {
 	"BEGIN", "NO_EXPIRE", "HELD", "COLLIDED", ""
 };
-template<> const Anope::string* Flags<NickNameFlag>::flags_strings = NickNameFlagStrings;
+template<> const Anope::string* Flags<NickNameFlag, NS_END>::flags_strings = NickNameFlagStrings;
 
 static const Anope::string NickCoreFlagStrings[] = {
 	"BEGIN", "KILLPROTECT", "SECURE", "MSG", "MEMO_HARDMAX", "MEMO_SIGNON", "MEMO_RECEIVE",
 	"PRIVATE", "HIDE_EMAIL", "HIDE_MASK", "HIDE_QUIT", "KILL_QUICK", "KILL_IMMED",
 	"MEMO_MAIL", "HIDE_STATUS", "SUSPENDED", "AUTOOP", "UNCONFIRMED", "STATS", ""
 };
-template<> const Anope::string* Flags<NickCoreFlag>::flags_strings = NickCoreFlagStrings;
+template<> const Anope::string* Flags<NickCoreFlag, NI_END>::flags_strings = NickCoreFlagStrings;
 
 NickCore::NickCore(const Anope::string &coredisplay) : Serializable("NickCore")
 {
@@ -16,51 +16,139 @@
 #include "users.h"
 #include "regchannel.h"
 
+/* The pieces of the line currently being processed. These live across calls
+ * so the strings and the parameter vector keep their storage between lines,
+ * which means tokenizing usually does not need to allocate anything.
+ */
+static Anope::string source, command;
+static std::vector<Anope::string> params;
+
+/* Commands received from the uplink and the IRCDMessage handling them. Resolving a
+ * message through Service::FindService builds the service name and walks the service
+ * and alias maps, so the result is remembered here until the services change, which
+ * only happens when modules are loaded or unloaded.
+ */
+typedef Anope::hash_map<IRCDMessage *> message_map;
+static message_map message_table;
+static unsigned message_table_generation;
+
+/** Finds the handler for a command
+ * @param proto_name The name of the protocol module
+ * @param cmd The command
+ * @return The handler, or NULL if there is none
+ */
+static IRCDMessage *FindMessage(const Anope::string &proto_name, const Anope::string &cmd)
+{
+	if (message_table_generation != Service::GetGeneration())
+	{
+		message_table.clear();
+		message_table_generation = Service::GetGeneration();
+	}
+
+	message_map::const_iterator it = message_table.find(cmd);
+	if (it != message_table.end())
+		return it->second;
+
+	IRCDMessage *m = static_cast<IRCDMessage *>(Service::FindService("IRCDMessage", proto_name + "/" + cmd.lower()));
+	/* Unknown commands aren't remembered, as the uplink could send any number of them */
+	if (m)
+		message_table[cmd] = m;
+	return m;
+}
+
+/** Skips a run of spaces
+ * @param p The current position
+ * @param end The end of the line
+ * @return The first position at or after p that is not a space
+ */
+static inline const char *SkipSpaces(const char *p, const char *end)
+{
+	while (p != end && *p == ' ')
+		++p;
+	return p;
+}
+
+/** Finds the end of the token starting at p
+ * @param p The start of the token
+ * @param end The end of the line
+ * @return The position of the space following the token, or end
+ */
+static inline const char *TokenEnd(const char *p, const char *end)
+{
+	const char *space = static_cast<const char *>(memchr(p, ' ', end - p));
+	return space ? space : end;
+}
+
+/** Assigns the remainder of the line to dest, collapsing runs of spaces into one
+ * @param dest The string to assign to
+ * @param p The start of the remainder
+ * @param end The end of the line
+ */
+static void AssignCollapsed(Anope::string &dest, const char *p, const char *end)
+{
+	std::string &s = dest.str();
+	s.clear();
+
+	while (p != end)
+	{
+		const char *space = static_cast<const char *>(memchr(p, ' ', end - p));
+		if (space == NULL)
+		{
+			s.append(p, end - p);
+			break;
+		}
+
+		s.append(p, space - p + 1);
+		p = SkipSpaces(space + 1, end);
+	}
+}
+
 void Anope::Process(const Anope::string &buffer)
 {
 	/* If debugging, log the buffer */
 	Log(LOG_RAWIO) << "Received: " << buffer;
 
-	/* Strip all extra spaces */
-	Anope::string buf = buffer;
-	while (buf.find("  ") != Anope::string::npos)
-		buf = buf.replace_all_cs("  ", " ");
+	const char *p = buffer.c_str(), *end = p + buffer.length();
 
-	if (buf.empty())
+	p = SkipSpaces(p, end);
+	if (p == end)
 		return;
 
-	Anope::string source;
-	if (buf[0] == ':')
+	source.clear();
+	if (*p == ':')
 	{
-		size_t space = buf.find_first_of(" ");
-		if (space == Anope::string::npos)
+		const char *space = static_cast<const char *>(memchr(p, ' ', end - p));
+		if (space == NULL)
 			return;
-		source = buf.substr(1, space - 1);
-		buf = buf.substr(space + 1);
-		if (source.empty() || buf.empty())
+		source.str().assign(p + 1, space - p - 1);
+		p = SkipSpaces(space, end);
+		if (source.empty() || p == end)
 			return;
 	}
 
-	spacesepstream buf_sep(buf);
+	const char *token_end = TokenEnd(p, end);
+	command.str().assign(p, token_end - p);
+	p = token_end;
 
-	Anope::string command = buf;
-	buf_sep.GetToken(command);
-	
-	Anope::string buf_token;
-	std::vector<Anope::string> params;
-	while (buf_sep.GetToken(buf_token))
+	unsigned count = 0;
+	while ((p = SkipSpaces(p, end)) != end)
 	{
-		if (buf_token[0] == ':')
+		if (count == params.size())
+			params.push_back("");
+		Anope::string &param = params[count++];
+
+		/* The last parameter, which may contain spaces */
+		if (*p == ':')
 		{
-			if (!buf_sep.StreamEnd())
-				params.push_back(buf_token.substr(1) + " " + buf_sep.GetRemaining());
-			else
-				params.push_back(buf_token.substr(1));
+			AssignCollapsed(param, p + 1, end);
 			break;
 		}
-		else
-			params.push_back(buf_token);
+
+		token_end = TokenEnd(p, end);
+		param.str().assign(p, token_end - p);
+		p = token_end;
 	}
+	params.resize(count);
 
 	if (Anope::ProtocolDebug)
 	{
@@ -83,7 +171,7 @@ void Anope::Process(const Anope::string &buffer)
 	if (MOD_RESULT == EVENT_STOP)
 		return;
 
-	ServiceReference<IRCDMessage> m("IRCDMessage", proto_name + "/" + command.lower());
+	IRCDMessage *m = FindMessage(proto_name, command);
 	if (!m)
 	{
 		Log(LOG_DEBUG) << "unknown message from server (" << buffer << ")";
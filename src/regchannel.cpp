@@ -28,7 +28,7 @@ static const Anope::string ChannelInfoFlagStrings[] = {
 	"PEACE", "SECURE", "NO_EXPIRE", "MEMO_HARDMAX", "SECUREFOUNDER",
 	"SIGNKICK", "SIGNKICK_LEVEL", "SUSPENDED", "PERSIST", "STATS", "NOAUTOOP", ""
 };
-template<> const Anope::string* Flags<ChannelInfoFlag>::flags_strings = ChannelInfoFlagStrings;
+template<> const Anope::string* Flags<ChannelInfoFlag, CI_END>::flags_strings = ChannelInfoFlagStrings;
 
 static const Anope::string AutoKickFlagString[] = { "AK_ISNICK", "" };
 template<> const Anope::string* Flags<AutoKickFlag>::flags_strings = AutoKickFlagString;
@@ -142,7 +142,7 @@ void ModeLock::Serialize(Serialize::Data &data) const
 	if (!this->ci)
 		return;
 
-	const Anope::string* ChannelModeNameStrings = Flags<ChannelModeName>::GetFlagStrings();
+	const Anope::string* ChannelModeNameStrings = Flags<ChannelModeName, CMODE_END * 2>::GetFlagStrings();
 	data["ci"] << this->ci->name;
 	data["set"] << this->set;
 	data["name"] << ChannelModeNameStrings[this->name];
@@ -164,7 +164,7 @@ Serializable* ModeLock::Unserialize(Serializable *obj, Serialize::Data &data)
 
 	ChannelModeName name = CMODE_END;
 
-	const Anope::string* ChannelModeNameStrings = Flags<ChannelModeName>::GetFlagStrings();
+	const Anope::string* ChannelModeNameStrings = Flags<ChannelModeName, CMODE_END * 2>::GetFlagStrings();
 	for (unsigned i = 0; !ChannelModeNameStrings[i].empty(); ++i)
 		if (ChannelModeNameStrings[i] == sname)
 		{
@@ -566,10 +566,19 @@ AccessGroup ChannelInfo::AccessFor(const User *u)
 
 	if (group.founder || !group.empty())
 	{
-		this->last_used = Anope::CurTime;
+		/* These are checked often, so the databases are only told when the time has changed */
+		if (this->last_used != Anope::CurTime)
+		{
+			this->last_used = Anope::CurTime;
+			this->QueueUpdate();
+		}
 
 		for (unsigned i = 0; i < group.size(); ++i)
-			group[i]->last_seen = Anope::CurTime;
+			if (group[i]->last_seen != Anope::CurTime)
+			{
+				group[i]->last_seen = Anope::CurTime;
+				group[i]->QueueUpdate();
+			}
 	}
 
 	return group;
@@ -589,10 +598,18 @@ AccessGroup ChannelInfo::AccessFor(const NickCore *nc)
 	
 	if (group.founder || !group.empty())
 	{
-		this->last_used = Anope::CurTime;
+		if (this->last_used != Anope::CurTime)
+		{
+			this->last_used = Anope::CurTime;
+			this->QueueUpdate();
+		}
 
 		for (unsigned i = 0; i < group.size(); ++i)
-			group[i]->last_seen = Anope::CurTime;
+			if (group[i]->last_seen != Anope::CurTime)
+			{
+				group[i]->last_seen = Anope::CurTime;
+				group[i]->QueueUpdate();
+			}
 	}
 
 	return group;
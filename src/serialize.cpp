@@ -26,6 +26,8 @@ using namespace Serialize;
 std::vector<Anope::string> Type::TypeOrder;
 std::map<Anope::string, Type *> Serialize::Type::Types;
 std::list<Serializable *> *Serializable::SerializableItems;
+unsigned int Serializable::generation = 1;
+unsigned long Serializable::updates_queued = 0, Serializable::updates_avoided = 0;
 
 void Serialize::RegisterTypes()
 {
@@ -35,12 +37,12 @@ void Serialize::RegisterTypes()
 		memo("Memo", Memo::Unserialize), xline("XLine", XLine::Unserialize);
 }
 
-Serializable::Serializable() : last_commit(NULL), last_commit_time(0), id(0)
+Serializable::Serializable() : last_commit(NULL), last_queued(0), id(0)
 {
 	throw CoreException("Default Serializable constructor?");
 }
 
-Serializable::Serializable(const Anope::string &serialize_type) : last_commit(NULL), last_commit_time(0), id(0)
+Serializable::Serializable(const Anope::string &serialize_type) : last_commit(NULL), last_queued(0), id(0)
 {
 	if (SerializableItems == NULL)
 		SerializableItems = new std::list<Serializable *>();
@@ -54,7 +56,7 @@ Serializable::Serializable(const Anope::string &serialize_type) : last_commit(NU
 	FOREACH_MOD(I_OnSerializableConstruct, OnSerializableConstruct(this));
 }
 
-Serializable::Serializable(const Serializable &other) : last_commit(NULL), last_commit_time(0), id(0)
+Serializable::Serializable(const Serializable &other) : last_commit(NULL), last_queued(0), id(0)
 {
 	SerializableItems->push_back(this);
 	this->s_iter = SerializableItems->end();
@@ -88,6 +90,14 @@ void Serializable::Destroy()
 
 void Serializable::QueueUpdate()
 {
+	if (this->last_queued == generation)
+	{
+		++updates_avoided;
+		return;
+	}
+	this->last_queued = generation;
+	++updates_queued;
+
 	/* Check for modifications now */
 	FOREACH_MOD(I_OnSerializeCheck, OnSerializeCheck(this->GetSerializableType()));
 	/* Schedule updater */
@@ -105,19 +115,26 @@ void Serializable::UpdateCache(Serialize::Data *data)
 	this->last_commit = data;
 }
 
-bool Serializable::IsTSCached()
+const std::list<Serializable *> &Serializable::GetItems()
 {
-	return this->last_commit_time == Anope::CurTime;
+	return *SerializableItems;
 }
 
-void Serializable::UpdateTS()
+void Serializable::NextGeneration()
 {
-	this->last_commit_time = Anope::CurTime;
+	/* Skip 0, which objects that were never queued have */
+	if (!++generation)
+		++generation;
 }
 
-const std::list<Serializable *> &Serializable::GetItems()
+unsigned long Serializable::GetUpdatesQueued()
 {
-	return *SerializableItems;
+	return updates_queued;
+}
+
+unsigned long Serializable::GetUpdatesAvoided()
+{
+	return updates_avoided;
 }
 
 Type::Type(const Anope::string &n, unserialize_func f, Module *o)  : name(n), unserialize(f), owner(o), timestamp(0)
@@ -135,6 +135,7 @@ Server::~Server()
 				{
 					na->last_seen = Anope::CurTime;
 					na->last_quit = this->quit_reason;
+					na->QueueUpdate();
 				}
 
 				delete u;
@@ -14,51 +14,276 @@
 #include "sockets.h"
 #include "socketengine.h"
 
-BufferedSocket::BufferedSocket()
+#include <errno.h>
+
+/** Check whether the last socket call failed only because it would have blocked
+ * @return true if it would have blocked
+ */
+static bool WouldBlock()
 {
+#ifndef _WIN32
+	int err = Anope::LastErrorCode();
+	return err == EAGAIN || err == EWOULDBLOCK;
+#else
+	return Anope::LastErrorCode() == WSAEWOULDBLOCK;
+#endif
 }
 
-BufferedSocket::~BufferedSocket()
+/** Writes as much of a send queue to a socket as it will take. Level-triggered sockets
+ * write once, as the engine will report them again if there is more to write, but
+ * edge-triggered sockets keep writing until the socket would block.
+ * @param s The socket
+ * @param queue The queue to write from
+ * @return false if the write failed
+ */
+static bool FlushQueue(Socket *s, SendQueue &queue)
 {
+	bool edge = SocketEngine::IsEdgeTriggered(s);
+
+	for (unsigned i = 0; !queue.Empty(); ++i)
+	{
+		if (edge && i == SocketEngine::DrainLimit)
+		{
+			SocketEngine::Rearm(s);
+			return true;
+		}
+
+		const char *segments[NET_MAXSEGMENTS];
+		size_t lens[NET_MAXSEGMENTS];
+		int count = queue.GetSegments(segments, lens, NET_MAXSEGMENTS);
+
+		size_t wanted = 0;
+		for (int j = 0; j < count; ++j)
+			wanted += lens[j];
+
+		int written = s->io->Send(s, segments, lens, count);
+		if (written <= -1)
+		{
+			if (edge && WouldBlock())
+				return true;
+			return false;
+		}
+		queue.Consume(written);
+
+		/* A short write means the socket buffer is full */
+		if (!edge || static_cast<size_t>(written) < wanted)
+			break;
+	}
+
+	if (queue.Empty())
+		SocketEngine::Change(s, false, SF_WRITABLE);
+
+	return true;
 }
 
-bool BufferedSocket::ProcessRead()
+SendQueue::SendQueue() : length(0)
 {
-	char tbuffer[NET_BUFSIZE];
+}
 
-	this->recv_len = 0;
+SendQueue::~SendQueue()
+{
+	this->Clear();
+	for (unsigned i = 0; i < this->blocks.size(); ++i)
+		delete this->blocks[i];
+}
 
-	int len = this->io->Recv(this, tbuffer, sizeof(tbuffer) - 1);
-	if (len <= 0)
-		return false;
-	
-	tbuffer[len] = 0;
-	this->recv_len = len;
-
-	Anope::string sbuffer = this->extra_buf;
-	sbuffer += tbuffer;
-	this->extra_buf.clear();
-	size_t lastnewline = sbuffer.rfind('\n');
-	if (lastnewline == Anope::string::npos)
+void SendQueue::Append(const char *data, size_t len)
+{
+	this->length += len;
+
+	while (len > 0)
 	{
-		this->extra_buf = sbuffer;
-		return true;
+		if (this->blocks.empty() || this->blocks.back()->end == BlockSize)
+			this->blocks.push_back(new Block());
+
+		Block *b = this->blocks.back();
+		size_t l = std::min(len, BlockSize - b->end);
+		memcpy(b->data + b->end, data, l);
+		b->end += l;
+
+		data += l;
+		len -= l;
 	}
-	if (lastnewline < sbuffer.length() - 1)
+}
+
+int SendQueue::GetSegments(const char **segments, size_t *lens, int max) const
+{
+	int count = 0;
+	for (unsigned i = 0; i < this->blocks.size() && count < max; ++i)
 	{
-		this->extra_buf = sbuffer.substr(lastnewline);
-		this->extra_buf.trim();
-		sbuffer = sbuffer.substr(0, lastnewline);
+		const Block *b = this->blocks[i];
+		if (b->start == b->end)
+			continue;
+
+		segments[count] = b->data + b->start;
+		lens[count] = b->end - b->start;
+		++count;
 	}
+	return count;
+}
 
-	sepstream stream(sbuffer, '\n');
+void SendQueue::Consume(size_t len)
+{
+	if (len > this->length)
+		len = this->length;
+	this->length -= len;
+
+	while (len > 0)
+	{
+		Block *b = this->blocks.front();
+		size_t l = std::min(len, b->end - b->start);
+		b->start += l;
+		len -= l;
+
+		if (b->start == b->end)
+		{
+			/* Keep the last block around so the next write does not need a new one */
+			if (this->blocks.size() == 1)
+				b->start = b->end = 0;
+			else
+			{
+				delete b;
+				this->blocks.pop_front();
+			}
+		}
+	}
+}
+
+void SendQueue::Clear()
+{
+	this->Consume(this->length);
+}
+
+size_t SendQueue::Length() const
+{
+	return this->length;
+}
+
+bool SendQueue::Empty() const
+{
+	return this->length == 0;
+}
+
+RecvQueue::RecvQueue() : buffer(NULL), size(0), start(0), end(0)
+{
+}
+
+RecvQueue::~RecvQueue()
+{
+	delete [] this->buffer;
+}
+
+char *RecvQueue::Reserve(size_t len, size_t &avail)
+{
+	if (this->size - this->end < len)
+	{
+		size_t used = this->end - this->start;
+
+		if (this->size - used >= len)
+			/* There is enough room if the data is moved back to the start */
+			memmove(this->buffer, this->buffer + this->start, used);
+		else
+		{
+			size_t newsize = std::max(this->size * 2, used + len);
+			char *newbuffer = new char[newsize];
+			if (used)
+				memcpy(newbuffer, this->buffer + this->start, used);
+			delete [] this->buffer;
+			this->buffer = newbuffer;
+			this->size = newsize;
+		}
+
+		this->start = 0;
+		this->end = used;
+	}
+
+	avail = this->size - this->end;
+	return this->buffer + this->end;
+}
+
+void RecvQueue::Commit(size_t len)
+{
+	this->end += len;
+}
 
+void RecvQueue::Consume(size_t len)
+{
+	this->start += std::min(len, this->end - this->start);
+	if (this->start == this->end)
+		this->start = this->end = 0;
+}
+
+const char *RecvQueue::Data() const
+{
+	return this->buffer + this->start;
+}
+
+size_t RecvQueue::Length() const
+{
+	return this->end - this->start;
+}
+
+BufferedSocket::BufferedSocket()
+{
+}
+
+BufferedSocket::~BufferedSocket()
+{
+}
+
+bool BufferedSocket::CanEdgeTrigger() const
+{
+	return this->io == &NormalSocketIO;
+}
+
+bool BufferedSocket::ProcessRead()
+{
+	bool edge = SocketEngine::IsEdgeTriggered(this);
 	Anope::string tbuf;
-	while (stream.GetToken(tbuf))
+
+	this->recv_len = 0;
+
+	for (unsigned i = 0;; ++i)
 	{
-		tbuf.trim();
-		if (!Read(tbuf))
+		if (edge && i == SocketEngine::DrainLimit)
+		{
+			SocketEngine::Rearm(this);
+			break;
+		}
+
+		size_t avail;
+		char *tbuffer = this->read_buffer.Reserve(NET_BUFSIZE, avail);
+		int len = this->io->Recv(this, tbuffer, avail);
+		if (len <= 0)
+		{
+			/* Edge-triggered sockets read until there is nothing left */
+			if (edge && len == -1 && WouldBlock())
+				break;
 			return false;
+		}
+
+		this->read_buffer.Commit(len);
+		this->recv_len += len;
+
+		const char *data = this->read_buffer.Data(), *data_end = data + this->read_buffer.Length(), *p = data;
+
+		for (const char *newline; (newline = static_cast<const char *>(memchr(p, '\n', data_end - p))) != NULL; p = newline + 1)
+		{
+			const char *line_start = p, *line_end = newline;
+			while (line_start != line_end && isspace(*line_start))
+				++line_start;
+			while (line_end != line_start && isspace(*(line_end - 1)))
+				--line_end;
+
+			tbuf.str().assign(line_start, line_end - line_start);
+			if (!Read(tbuf))
+				return false;
+		}
+
+		this->read_buffer.Consume(p - data);
+
+		if (!edge)
+			break;
 	}
 
 	return true;
@@ -66,14 +291,7 @@ bool BufferedSocket::ProcessRead()
 
 bool BufferedSocket::ProcessWrite()
 {
-	int count = this->io->Send(this, this->write_buffer);
-	if (count <= -1)
-		return false;
-	this->write_buffer = this->write_buffer.substr(count);
-	if (this->write_buffer.empty())
-		SocketEngine::Change(this, false, SF_WRITABLE);
-
-	return true;
+	return FlushQueue(this, this->write_buffer);
 }
 
 bool BufferedSocket::Read(const Anope::string &buf)
@@ -83,7 +301,8 @@ bool BufferedSocket::Read(const Anope::string &buf)
 
 void BufferedSocket::Write(const char *buffer, size_t l)
 {
-	this->write_buffer += buffer + Anope::string("\r\n");
+	this->write_buffer.Append(buffer, l);
+	this->write_buffer.Append("\r\n", 2);
 	SocketEngine::Change(this, true, SF_WRITABLE);
 }
 
@@ -99,7 +318,7 @@ void BufferedSocket::Write(const char *message, ...)
 	int len = vsnprintf(tbuffer, sizeof(tbuffer), message, vi);
 	va_end(vi);
 
-	this->Write(tbuffer, std::min(len, static_cast<int>(sizeof(tbuffer))));
+	this->Write(tbuffer, std::min(len, static_cast<int>(sizeof(tbuffer) - 1)));
 }
 
 void BufferedSocket::Write(const Anope::string &message)
@@ -114,74 +333,62 @@ int BufferedSocket::ReadBufferLen() const
 
 int BufferedSocket::WriteBufferLen() const
 {
-	return this->write_buffer.length();
+	return this->write_buffer.Length();
 }
 
 
-BinarySocket::DataBlock::DataBlock(const char *b, size_t l)
-{
-	this->orig = this->buf = new char[l];
-	memcpy(this->buf, b, l);
-	this->len = l;
-}
-
-BinarySocket::DataBlock::~DataBlock()
+BinarySocket::BinarySocket()
 {
-	delete [] this->orig;
 }
 
-BinarySocket::BinarySocket()
+BinarySocket::~BinarySocket()
 {
 }
 
-BinarySocket::~BinarySocket()
+bool BinarySocket::CanEdgeTrigger() const
 {
+	return this->io == &NormalSocketIO;
 }
 
 bool BinarySocket::ProcessRead()
 {
+	bool edge = SocketEngine::IsEdgeTriggered(this);
 	char tbuffer[NET_BUFSIZE];
 
-	int len = this->io->Recv(this, tbuffer, sizeof(tbuffer));
-	if (len <= 0)
-		return false;
-	
-	return this->Read(tbuffer, len);
-}
-
-bool BinarySocket::ProcessWrite()
-{
-	if (this->write_buffer.empty())
+	for (unsigned i = 0;; ++i)
 	{
-		SocketEngine::Change(this, false, SF_WRITABLE);
-		return true;
-	}
+		if (edge && i == SocketEngine::DrainLimit)
+		{
+			SocketEngine::Rearm(this);
+			break;
+		}
+
+		int len = this->io->Recv(this, tbuffer, sizeof(tbuffer));
+		if (len <= 0)
+		{
+			if (edge && len == -1 && WouldBlock())
+				break;
+			return false;
+		}
 
-	DataBlock *d = this->write_buffer.front();
+		if (!this->Read(tbuffer, len))
+			return false;
 
-	int len = this->io->Send(this, d->buf, d->len);
-	if (len <= -1)
-		return false;
-	else if (static_cast<size_t>(len) == d->len)
-	{
-		delete d;
-		this->write_buffer.pop_front();
-	}
-	else
-	{
-		d->buf += len;
-		d->len -= len;
+		if (!edge)
+			break;
 	}
 
-	if (this->write_buffer.empty())
-		SocketEngine::Change(this, false, SF_WRITABLE);
-
 	return true;
 }
 
+bool BinarySocket::ProcessWrite()
+{
+	return FlushQueue(this, this->write_buffer);
+}
+
 void BinarySocket::Write(const char *buffer, size_t l)
 {
-	this->write_buffer.push_back(new DataBlock(buffer, l));
+	this->write_buffer.Append(buffer, l);
 	SocketEngine::Change(this, true, SF_WRITABLE);
 }
 
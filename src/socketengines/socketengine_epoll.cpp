@@ -21,6 +21,21 @@
 
 static int EngineHandle;
 static std::vector<epoll_event> events;
+/* Whether each fd is registered edge-triggered, indexed by fd */
+static std::vector<bool> edge_triggered;
+
+/** Builds the events a socket should be registered for
+ * @param s The socket
+ * @return The events
+ */
+static uint32_t GetEvents(Socket *s)
+{
+	uint32_t e = (s->HasFlag(SF_READABLE) ? EPOLLIN : 0) | (s->HasFlag(SF_WRITABLE) ? EPOLLOUT : 0);
+	/* The config is not loaded yet when the first sockets are created */
+	if (Config && Config->EdgeTriggered && s->CanEdgeTrigger())
+		e |= EPOLLET;
+	return e;
+}
 
 void SocketEngine::Init()
 {
@@ -34,8 +49,8 @@ void SocketEngine::Init()
 
 void SocketEngine::Shutdown()
 {
-	while (!Sockets.empty())
-		delete Sockets.begin()->second;
+	for (unsigned i = 0; i < Sockets.size(); ++i)
+		delete Sockets[i];
 }
 
 void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
@@ -56,7 +71,7 @@ void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
 
 	memset(&ev, 0, sizeof(ev));
 
-	ev.events = (s->HasFlag(SF_READABLE) ? EPOLLIN : 0) | (s->HasFlag(SF_WRITABLE) ? EPOLLOUT : 0);
+	ev.events = GetEvents(s);
 	ev.data.fd = s->GetFD();
 
 	int mod;
@@ -71,11 +86,42 @@ void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
 	
 	if (epoll_ctl(EngineHandle, mod, ev.data.fd, &ev) == -1)
 		 throw SocketException("Unable to epoll_ctl() fd " + stringify(ev.data.fd) + " to epoll: " + Anope::LastError());
+
+	if (static_cast<unsigned>(ev.data.fd) >= edge_triggered.size())
+		edge_triggered.resize(ev.data.fd + 1);
+	edge_triggered[ev.data.fd] = mod != EPOLL_CTL_DEL && (ev.events & EPOLLET);
+}
+
+bool SocketEngine::IsEdgeTriggered(Socket *s)
+{
+	unsigned fd = s->GetFD();
+	return fd < edge_triggered.size() && edge_triggered[fd];
+}
+
+void SocketEngine::Rearm(Socket *s)
+{
+	if (!IsEdgeTriggered(s))
+		return;
+
+	/* Modifying the registration makes epoll check the socket again, so it is
+	 * reported on the next call if it is still ready
+	 */
+	epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+
+	ev.events = GetEvents(s);
+	ev.data.fd = s->GetFD();
+
+	if (epoll_ctl(EngineHandle, EPOLL_CTL_MOD, ev.data.fd, &ev) == -1)
+		Log() << "Unable to rearm fd " << ev.data.fd << ": " << Anope::LastError();
+
+	edge_triggered[ev.data.fd] = ev.events & EPOLLET;
 }
 
 void SocketEngine::Process()
 {
-	if (Sockets.size() > events.size())
+	if (NumSockets > events.size())
 		events.resize(events.size() * 2);
 
 	int total = epoll_wait(EngineHandle, &events.front(), events.size(), Config->ReadTimeout * 1000);
@@ -93,10 +139,9 @@ void SocketEngine::Process()
 	{
 		epoll_event &ev = events[i];
 
-		std::map<int, Socket *>::iterator it = Sockets.find(ev.data.fd);
-		if (it == Sockets.end())
+		Socket *s = FindSocket(ev.data.fd);
+		if (s == NULL)
 			continue;
-		Socket *s = it->second;
 
 		if (ev.events & (EPOLLHUP | EPOLLERR))
 		{
@@ -109,6 +154,9 @@ void SocketEngine::Process()
 		{
 			if (s->HasFlag(SF_DEAD))
 				delete s;
+			else
+				/* The events were not handled, so have them reported again */
+				Rearm(s);
 			continue;
 		}
 
@@ -46,8 +46,8 @@ void SocketEngine::Init()
 
 void SocketEngine::Shutdown()
 {
-	while (!Sockets.empty())
-		delete Sockets.begin()->second;
+	for (unsigned i = 0; i < Sockets.size(); ++i)
+		delete Sockets[i];
 }
 
 void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
@@ -72,9 +72,18 @@ void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
 	EV_SET(event, s->GetFD(), mod, set ? EV_ADD : EV_DELETE, 0, 0, NULL);
 }
 
+bool SocketEngine::IsEdgeTriggered(Socket *s)
+{
+	return false;
+}
+
+void SocketEngine::Rearm(Socket *s)
+{
+}
+
 void SocketEngine::Process()
 {
-	if (Sockets.size() > event_events.size())
+	if (NumSockets > event_events.size())
 		event_events.resize(event_events.size() * 2);
 
 	static timespec kq_timespec = { Config->ReadTimeout, 0 };
@@ -96,10 +105,9 @@ void SocketEngine::Process()
 		if (event.flags & EV_ERROR)
 			continue;
 
-		std::map<int, Socket *>::iterator it = Sockets.find(event.ident);
-		if (it == Sockets.end())
+		Socket *s = FindSocket(event.ident);
+		if (s == NULL)
 			continue;
-		Socket *s = it->second;
 
 		if (event.flags & EV_EOF)
 		{
@@ -33,7 +33,17 @@
 
 static std::vector<pollfd> events;
 static unsigned SocketCount;
-static std::map<int, unsigned> socket_positions;
+/* Position of each fd's pollfd in events, indexed by fd */
+static std::vector<unsigned> socket_positions;
+
+static const unsigned NotPolled = static_cast<unsigned>(-1);
+
+static inline unsigned GetPosition(int fd)
+{
+	if (fd < 0 || static_cast<unsigned>(fd) >= socket_positions.size())
+		return NotPolled;
+	return socket_positions[fd];
+}
 
 void SocketEngine::Init()
 {
@@ -42,8 +52,8 @@ void SocketEngine::Init()
 
 void SocketEngine::Shutdown()
 {
-	while (!Sockets.empty())
-		delete Sockets.begin()->second;
+	for (unsigned i = 0; i < Sockets.size(); ++i)
+		delete Sockets[i];
 }
 
 void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
@@ -71,42 +81,53 @@ void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
 		ev.fd = s->GetFD();
 		ev.events = (s->HasFlag(SF_READABLE) ? POLLIN : 0) | (s->HasFlag(SF_WRITABLE) ? POLLOUT : 0);
 
+		if (static_cast<unsigned>(ev.fd) >= socket_positions.size())
+			socket_positions.resize(ev.fd + 1, NotPolled);
 		socket_positions[ev.fd] = SocketCount;
 		++SocketCount;
 	}
 	else if (before_registered && !now_registered)
 	{
-		std::map<int, unsigned>::iterator pos = socket_positions.find(s->GetFD());
-		if (pos == socket_positions.end())
+		unsigned pos = GetPosition(s->GetFD());
+		if (pos == NotPolled)
 			throw SocketException("Unable to remove fd " + stringify(s->GetFD()) + " from poll, it does not exist?");
 
-		if (pos->second != SocketCount - 1)
+		if (pos != SocketCount - 1)
 		{
-			pollfd &ev = events[pos->second],
+			pollfd &ev = events[pos],
 				&last_ev = events[SocketCount - 1];
 
 			ev = last_ev;
 
-			socket_positions[ev.fd] = pos->second;
+			socket_positions[ev.fd] = pos;
 		}
 
-		socket_positions.erase(pos);
+		socket_positions[s->GetFD()] = NotPolled;
 		--SocketCount;
 	}
 	else if (before_registered && now_registered)
 	{
-		std::map<int, unsigned>::iterator pos = socket_positions.find(s->GetFD());
-		if (pos == socket_positions.end())
+		unsigned pos = GetPosition(s->GetFD());
+		if (pos == NotPolled)
 			throw SocketException("Unable to modify fd " + stringify(s->GetFD()) + " in poll, it does not exist?");
 
-		pollfd &ev = events[pos->second];
+		pollfd &ev = events[pos];
 		ev.events = (s->HasFlag(SF_READABLE) ? POLLIN : 0) | (s->HasFlag(SF_WRITABLE) ? POLLOUT : 0);
 	}
 }
 
+bool SocketEngine::IsEdgeTriggered(Socket *s)
+{
+	return false;
+}
+
+void SocketEngine::Rearm(Socket *s)
+{
+}
+
 void SocketEngine::Process()
 {
-	if (Sockets.size() > events.size())
+	if (NumSockets > events.size())
 		events.resize(events.size() * 2);
 
 	int total = poll(&events.front(), events.size(), Config->ReadTimeout * 1000);
@@ -127,10 +148,9 @@ void SocketEngine::Process()
 		if (ev->revents != 0)
 			++processed;
 
-		std::map<int, Socket *>::iterator it = Sockets.find(ev->fd);
-		if (it == Sockets.end())
+		Socket *s = FindSocket(ev->fd);
+		if (s == NULL)
 			continue;
-		Socket *s = it->second;
 
 		if (ev->revents & (POLLERR | POLLRDHUP))
 		{
@@ -34,8 +34,8 @@ void SocketEngine::Init()
 
 void SocketEngine::Shutdown()
 {
-	while (!Sockets.empty())
-		delete Sockets.begin()->second;
+	for (unsigned i = 0; i < Sockets.size(); ++i)
+		delete Sockets[i];
 }
 
 void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
@@ -84,6 +84,15 @@ void SocketEngine::Change(Socket *s, bool set, SocketFlag flag)
 	}
 }
 
+bool SocketEngine::IsEdgeTriggered(Socket *s)
+{
+	return false;
+}
+
+void SocketEngine::Rearm(Socket *s)
+{
+}
+
 void SocketEngine::Process()
 {
 	fd_set rfdset = ReadFDs, wfdset = WriteFDs, efdset = ReadFDs;
@@ -115,10 +124,11 @@ void SocketEngine::Process()
 	else if (sresult)
 	{
 		int processed = 0;
-		for (std::map<int, Socket *>::const_iterator it = Sockets.begin(), it_end = Sockets.end(); it != it_end && processed != sresult;)
+		for (unsigned i = 0; i < Sockets.size() && processed != sresult; ++i)
 		{
-			Socket *s = it->second;
-			++it;
+			Socket *s = Sockets[i];
+			if (s == NULL)
+				continue;
 
 			bool has_read = FD_ISSET(s->GetFD(), &rfdset), has_write = FD_ISSET(s->GetFD(), &wfdset), has_error = FD_ISSET(s->GetFD(), &efdset);
 			if (has_read || has_write || has_error)
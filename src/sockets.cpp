@@ -19,6 +19,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 static const Anope::string SocketFlagStrings[] = {
@@ -26,7 +27,8 @@ static const Anope::string SocketFlagStrings[] = {
 };
 template<> const Anope::string* Flags<SocketFlag>::flags_strings = SocketFlagStrings;
 
-std::map<int, Socket *> SocketEngine::Sockets;
+std::vector<Socket *> SocketEngine::Sockets;
+unsigned SocketEngine::NumSockets = 0;
 
 uint32_t TotalRead = 0;
 uint32_t TotalWritten = 0;
@@ -312,15 +314,17 @@ size_t cidr::hash::operator()(const cidr &s) const
 
 int SocketIO::Recv(Socket *s, char *buf, size_t sz)
 {
-	size_t i = recv(s->GetFD(), buf, sz, 0);
-	TotalRead += i;
+	int i = recv(s->GetFD(), buf, sz, 0);
+	if (i > 0)
+		TotalRead += i;
 	return i;
 }
 
 int SocketIO::Send(Socket *s, const char *buf, size_t sz)
 {
-	size_t i = send(s->GetFD(), buf, sz, 0);
-	TotalWritten += i;
+	int i = send(s->GetFD(), buf, sz, 0);
+	if (i > 0)
+		TotalWritten += i;
 	return i;
 }
 
@@ -329,6 +333,37 @@ int SocketIO::Send(Socket *s, const Anope::string &buf)
 	return this->Send(s, buf.c_str(), buf.length());
 }
 
+int SocketIO::Send(Socket *s, const char * const *bufs, const size_t *lens, int count)
+{
+#ifndef _WIN32
+	iovec iov[NET_MAXSEGMENTS];
+	if (count > NET_MAXSEGMENTS)
+		count = NET_MAXSEGMENTS;
+	for (int j = 0; j < count; ++j)
+	{
+		iov[j].iov_base = const_cast<char *>(bufs[j]);
+		iov[j].iov_len = lens[j];
+	}
+
+	int i = writev(s->GetFD(), iov, count);
+	if (i > 0)
+		TotalWritten += i;
+	return i;
+#else
+	int total = 0;
+	for (int j = 0; j < count; ++j)
+	{
+		int i = this->Send(s, bufs[j], lens[j]);
+		if (i <= -1)
+			return total ? total : i;
+		total += i;
+		if (static_cast<size_t>(i) != lens[j])
+			break;
+	}
+	return total;
+#endif
+}
+
 ClientSocket *SocketIO::Accept(ListenSocket *s)
 {
 	sockaddrs conaddr;
@@ -420,7 +455,7 @@ Socket::Socket(int s, bool i, int type)
 	else
 		this->sock = s;
 	this->SetBlocking(false);
-	SocketEngine::Sockets[this->sock] = this;
+	SocketEngine::AddSocket(this);
 	SocketEngine::Change(this, true, SF_READABLE);
 }
 
@@ -430,7 +465,31 @@ Socket::~Socket()
 	SocketEngine::Change(this, false, SF_WRITABLE);
 	anope_close(this->sock);
 	this->io->Destroy();
-	SocketEngine::Sockets.erase(this->sock);
+	SocketEngine::DelSocket(this);
+}
+
+void SocketEngine::AddSocket(Socket *s)
+{
+	int fd = s->GetFD();
+	if (fd < 0)
+		return;
+
+	if (static_cast<unsigned>(fd) >= Sockets.size())
+		Sockets.resize(std::max(static_cast<size_t>(fd) + 1, Sockets.size() * 2), NULL);
+
+	if (Sockets[fd] == NULL)
+		++NumSockets;
+	Sockets[fd] = s;
+}
+
+void SocketEngine::DelSocket(Socket *s)
+{
+	int fd = s->GetFD();
+	if (FindSocket(fd) != s)
+		return;
+
+	Sockets[fd] = NULL;
+	--NumSockets;
 }
 
 int Socket::GetFD() const
@@ -462,6 +521,11 @@ bool Socket::Process()
 	return true;
 }
 
+bool Socket::CanEdgeTrigger() const
+{
+	return false;
+}
+
 bool Socket::ProcessRead()
 {
 	return true;
@@ -13,9 +13,16 @@
 #include "services.h"
 #include "threadengine.h"
 #include "anope.h"
+#include "sockets.h"
+#include "config.h"
+#include "logger.h"
 
 #ifndef _WIN32
 #include <pthread.h>
+#include <sys/time.h>
+#endif
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
 #endif
 
 static inline pthread_attr_t *get_engine_attr()
@@ -41,6 +48,7 @@ static void *entry_point(void *parameter)
 	Thread *thread = static_cast<Thread *>(parameter);
 	thread->Run();
 	thread->SetExitState();
+	CompletionQueue::Post(thread);
 	pthread_exit(0);
 	return NULL;
 }
@@ -61,23 +69,20 @@ void Thread::Join()
 
 void Thread::SetExitState()
 {
-	this->Notify();
 	exit = true;
 }
 
 void Thread::Exit()
 {
 	this->SetExitState();
+	CompletionQueue::Post(this);
 	pthread_exit(0);
 }
 
 void Thread::Start()
 {
 	if (pthread_create(&this->handle, get_engine_attr(), entry_point, this))
-	{
-		this->SetFlag(SF_DEAD);
 		throw CoreException("Unable to create thread: " + Anope::LastError());
-	}
 }
 
 bool Thread::GetExitState() const
@@ -85,10 +90,15 @@ bool Thread::GetExitState() const
 	return exit;
 }
 
+void Thread::OnComplete()
+{
+	this->OnNotify();
+}
+
 void Thread::OnNotify()
 {
 	this->Join();
-	this->SetFlag(SF_DEAD);
+	delete this;
 }
 
 Mutex::Mutex()
@@ -131,7 +141,413 @@ void Condition::Wakeup()
 	pthread_cond_signal(&cond);
 }
 
+void Condition::WakeupAll()
+{
+	pthread_cond_broadcast(&cond);
+}
+
 void Condition::Wait()
 {
 	pthread_cond_wait(&cond, &mutex);
 }
+
+static uint64_t GetTimeUS()
+{
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+/* Wakes the main loop when the first completion is posted to an empty queue */
+#ifdef HAVE_EVENTFD
+class CompletionNotifier : public Socket
+{
+	static int CreateEventFD()
+	{
+		int fd = eventfd(0, EFD_NONBLOCK);
+		if (fd < 0)
+			throw CoreException("Could not create eventfd: " + Anope::LastError());
+		return fd;
+	}
+
+ public:
+	CompletionNotifier() : Socket(CreateEventFD()) { }
+	~CompletionNotifier();
+
+	bool ProcessRead() anope_override
+	{
+		/* Reset the counter before running the queue, so a completion posted while it runs wakes the loop again */
+		eventfd_t count;
+		eventfd_read(this->GetFD(), &count);
+		CompletionQueue::Process();
+		return true;
+	}
+
+	void Notify()
+	{
+		eventfd_write(this->GetFD(), 1);
+	}
+};
+#else
+class CompletionNotifier : public Pipe
+{
+ public:
+	~CompletionNotifier();
+
+	bool ProcessRead() anope_override
+	{
+		/* Empty the pipe before running the queue, so a completion posted while it runs wakes the loop again */
+		char dummy[512];
+		while (this->Read(dummy, sizeof(dummy)) == sizeof(dummy));
+		CompletionQueue::Process();
+		return true;
+	}
+
+	void OnNotify() anope_override { }
+};
+#endif
+
+/* Guards the completions posted but not yet taken by Process and the statistics */
+static Mutex completion_lock;
+static std::deque<Completion *> completions_posted;
+/* The completions being run by Process, only used by the main thread */
+static std::deque<Completion *> completions_running;
+static CompletionNotifier *completion_notifier;
+static unsigned long completions_completed, completion_wakeups;
+static uint64_t completion_latency, completion_max_latency;
+
+CompletionNotifier::~CompletionNotifier()
+{
+	completion_lock.Lock();
+	completion_notifier = NULL;
+	completion_lock.Unlock();
+}
+
+Completion::Completion() : queued(false), posted(0)
+{
+}
+
+Completion::~Completion()
+{
+	CompletionQueue::Cancel(this);
+}
+
+void CompletionQueue::Init()
+{
+	if (!completion_notifier)
+		completion_notifier = new CompletionNotifier();
+}
+
+void CompletionQueue::Post(Completion *c)
+{
+	completion_lock.Lock();
+	if (c->queued)
+	{
+		completion_lock.Unlock();
+		return;
+	}
+
+	c->queued = true;
+	c->posted = GetTimeUS();
+	completions_posted.push_back(c);
+
+	/* Anything posted before this has already woken the main loop */
+	if (completions_posted.size() == 1 && completion_notifier)
+	{
+		++completion_wakeups;
+		completion_notifier->Notify();
+	}
+	completion_lock.Unlock();
+}
+
+void CompletionQueue::Cancel(Completion *c)
+{
+	completion_lock.Lock();
+	if (c->queued)
+	{
+		c->queued = false;
+		std::deque<Completion *>::iterator it = std::find(completions_posted.begin(), completions_posted.end(), c);
+		if (it != completions_posted.end())
+			completions_posted.erase(it);
+	}
+	completion_lock.Unlock();
+
+	std::replace(completions_running.begin(), completions_running.end(), c, static_cast<Completion *>(NULL));
+}
+
+void CompletionQueue::Process()
+{
+	/* Completions posted from here on wait for the next run */
+	completion_lock.Lock();
+	completions_running.insert(completions_running.end(), completions_posted.begin(), completions_posted.end());
+	completions_posted.clear();
+	completion_lock.Unlock();
+
+	uint64_t now = GetTimeUS();
+	while (!completions_running.empty())
+	{
+		Completion *c = completions_running.front();
+		completions_running.pop_front();
+		if (c == NULL)
+			continue;
+
+		/* It may be posted again from here on, or deleted by OnComplete */
+		completion_lock.Lock();
+		c->queued = false;
+		uint64_t latency = now > c->posted ? now - c->posted : 0;
+		++completions_completed;
+		completion_latency += latency;
+		if (latency > completion_max_latency)
+			completion_max_latency = latency;
+		completion_lock.Unlock();
+
+		c->OnComplete();
+	}
+}
+
+unsigned long CompletionQueue::GetCompleted()
+{
+	return completions_completed;
+}
+
+unsigned long CompletionQueue::GetWakeups()
+{
+	return completion_wakeups;
+}
+
+unsigned long CompletionQueue::GetAverageLatency()
+{
+	return completions_completed ? completion_latency / completions_completed : 0;
+}
+
+unsigned long CompletionQueue::GetMaxLatency()
+{
+	return completion_max_latency;
+}
+
+/* A thread of the ThreadPool */
+class PoolThread : public Thread
+{
+ public:
+	/* The task being run by this thread, if any */
+	Task *current;
+
+	PoolThread() : current(NULL) { }
+
+	void Run() anope_override;
+};
+
+/* Guards everything about the pool, and is waited on by idle threads and by Cancel */
+static Condition pool_lock;
+static std::deque<Task *> pool_tasks;
+static std::vector<PoolThread *> pool_threads;
+static unsigned pool_max = 1, pool_idle, pool_cancelling, pool_max_queued;
+static bool pool_stopping;
+static unsigned long pool_completed;
+static uint64_t pool_wait, pool_max_wait, pool_run, pool_max_run;
+
+void PoolThread::Run()
+{
+	pool_lock.Lock();
+	for (;;)
+	{
+		if (pool_tasks.empty())
+		{
+			/* Threads only stop once there is nothing left to run */
+			if (pool_stopping || pool_threads.size() > pool_max)
+				break;
+
+			++pool_idle;
+			pool_lock.Wait();
+			--pool_idle;
+			continue;
+		}
+
+		Task *t = pool_tasks.front();
+		pool_tasks.pop_front();
+		this->current = t;
+
+		uint64_t start = GetTimeUS(), wait = start > t->submitted ? start - t->submitted : 0;
+		pool_wait += wait;
+		if (wait > pool_max_wait)
+			pool_max_wait = wait;
+		pool_lock.Unlock();
+
+		t->Run();
+
+		uint64_t end = GetTimeUS(), run = end > start ? end - start : 0;
+		pool_lock.Lock();
+		this->current = NULL;
+		++pool_completed;
+		pool_run += run;
+		if (run > pool_max_run)
+			pool_max_run = run;
+		CompletionQueue::Post(t);
+
+		if (pool_cancelling)
+			pool_lock.WakeupAll();
+	}
+
+	/* A thread leaving because options:threads was lowered is joined once it is completed, Shutdown joins the rest */
+	if (!pool_stopping)
+		pool_threads.erase(std::find(pool_threads.begin(), pool_threads.end(), this));
+	pool_lock.Unlock();
+}
+
+Task::Task(int p) : submitted(0), priority(p)
+{
+}
+
+Task::~Task()
+{
+	pool_lock.Lock();
+	std::deque<Task *>::iterator it = std::find(pool_tasks.begin(), pool_tasks.end(), this);
+	if (it != pool_tasks.end())
+		pool_tasks.erase(it);
+	pool_lock.Unlock();
+}
+
+void Task::OnComplete()
+{
+	delete this;
+}
+
+void ThreadPool::Submit(Task *t)
+{
+	pool_lock.Lock();
+
+	pool_max = Config && Config->MaxThreads ? Config->MaxThreads : 1;
+	t->submitted = GetTimeUS();
+
+	/* Keep the queue sorted by priority, and in the order tasks were submitted within a priority */
+	std::deque<Task *>::iterator it = pool_tasks.end();
+	while (it != pool_tasks.begin() && (*(it - 1))->priority < t->priority)
+		--it;
+	pool_tasks.insert(it, t);
+	if (pool_tasks.size() > pool_max_queued)
+		pool_max_queued = pool_tasks.size();
+
+	if (pool_idle || pool_threads.size() >= pool_max)
+	{
+		pool_lock.Wakeup();
+		pool_lock.Unlock();
+		return;
+	}
+
+	if (!pool_stopping)
+	{
+		PoolThread *pt = new PoolThread();
+		try
+		{
+			pt->Start();
+			pool_threads.push_back(pt);
+			pool_lock.Unlock();
+			return;
+		}
+		catch (const CoreException &ex)
+		{
+			delete pt;
+			Log() << "Unable to start a thread for the thread pool: " << ex.GetReason();
+		}
+	}
+
+	/* Nothing else will run it, so run it now */
+	if (pool_threads.empty())
+	{
+		pool_tasks.erase(std::find(pool_tasks.begin(), pool_tasks.end(), t));
+		pool_lock.Unlock();
+		t->Run();
+		CompletionQueue::Post(t);
+		return;
+	}
+
+	pool_lock.Unlock();
+}
+
+bool ThreadPool::Cancel(Task *t)
+{
+	pool_lock.Lock();
+
+	std::deque<Task *>::iterator it = std::find(pool_tasks.begin(), pool_tasks.end(), t);
+	if (it != pool_tasks.end())
+	{
+		pool_tasks.erase(it);
+		pool_lock.Unlock();
+		return true;
+	}
+
+	++pool_cancelling;
+	for (unsigned i = 0; i < pool_threads.size();)
+	{
+		if (pool_threads[i]->current == t)
+		{
+			pool_lock.Wait();
+			i = 0;
+		}
+		else
+			++i;
+	}
+	--pool_cancelling;
+
+	pool_lock.Unlock();
+	return false;
+}
+
+void ThreadPool::Shutdown()
+{
+	pool_lock.Lock();
+	pool_stopping = true;
+	std::vector<PoolThread *> threads = pool_threads;
+	pool_threads.clear();
+	pool_lock.WakeupAll();
+	pool_lock.Unlock();
+
+	for (unsigned i = 0; i < threads.size(); ++i)
+	{
+		threads[i]->Join();
+		delete threads[i];
+	}
+
+	/* Complete what was run while stopping */
+	CompletionQueue::Process();
+}
+
+unsigned ThreadPool::GetThreads()
+{
+	return pool_threads.size();
+}
+
+unsigned ThreadPool::GetQueued()
+{
+	return pool_tasks.size();
+}
+
+unsigned ThreadPool::GetMaxQueued()
+{
+	return pool_max_queued;
+}
+
+unsigned long ThreadPool::GetCompleted()
+{
+	return pool_completed;
+}
+
+unsigned long ThreadPool::GetAverageWait()
+{
+	return pool_completed ? pool_wait / pool_completed : 0;
+}
+
+unsigned long ThreadPool::GetMaxWait()
+{
+	return pool_max_wait;
+}
+
+unsigned long ThreadPool::GetAverageRun()
+{
+	return pool_completed ? pool_run / pool_completed : 0;
+}
+
+unsigned long ThreadPool::GetMaxRun()
+{
+	return pool_max_run;
+}
@@ -12,7 +12,9 @@
 
 std::vector<Timer *> TimerManager::Timers;
 
-Timer::Timer(long time_from_now, time_t now, bool repeating)
+static const size_t NotQueued = static_cast<size_t>(-1);
+
+Timer::Timer(long time_from_now, time_t now, bool repeating) : heap_index(NotQueued)
 {
 	trigger = now + time_from_now;
 	secs = time_from_now;
@@ -30,6 +32,8 @@ Timer::~Timer()
 void Timer::SetTimer(time_t t)
 {
 	trigger = t;
+
+	TimerManager::UpdateTimer(this);
 }
 
 time_t Timer::GetTimer() const
@@ -52,8 +56,7 @@ void Timer::SetSecs(time_t t)
 	secs = t;
 	trigger = Anope::CurTime + t;
 
-	TimerManager::DelTimer(this);
-	TimerManager::AddTimer(this);
+	TimerManager::UpdateTimer(this);
 }
 
 long Timer::GetSecs() const
@@ -61,33 +64,81 @@ long Timer::GetSecs() const
 	return secs;
 }
 
+void TimerManager::Place(Timer *t, size_t index)
+{
+	Timers[index] = t;
+	t->heap_index = index;
+}
+
+void TimerManager::Reposition(size_t index)
+{
+	Timer *t = Timers[index];
+
+	while (index > 0)
+	{
+		size_t parent = (index - 1) / 2;
+		if (!TimerComparison(t, Timers[parent]))
+			break;
+		Place(Timers[parent], index);
+		index = parent;
+	}
+
+	for (size_t child; (child = index * 2 + 1) < Timers.size(); index = child)
+	{
+		if (child + 1 < Timers.size() && TimerComparison(Timers[child + 1], Timers[child]))
+			++child;
+		if (!TimerComparison(Timers[child], t))
+			break;
+		Place(Timers[child], index);
+	}
+
+	Place(t, index);
+}
+
 void TimerManager::AddTimer(Timer *t)
 {
+	if (t->heap_index != NotQueued)
+		return;
+
 	Timers.push_back(t);
-	sort(Timers.begin(), Timers.end(), TimerManager::TimerComparison);
+	t->heap_index = Timers.size() - 1;
+	Reposition(t->heap_index);
 }
 
 void TimerManager::DelTimer(Timer *t)
 {
-	std::vector<Timer *>::iterator i = std::find(Timers.begin(), Timers.end(), t);
+	size_t index = t->heap_index;
+	if (index == NotQueued)
+		return;
+
+	t->heap_index = NotQueued;
 
-	if (i != Timers.end())
-		Timers.erase(i);
+	Timer *last = Timers.back();
+	Timers.pop_back();
+
+	if (last != t)
+	{
+		Place(last, index);
+		Reposition(index);
+	}
+}
+
+void TimerManager::UpdateTimer(Timer *t)
+{
+	if (t->heap_index != NotQueued)
+		Reposition(t->heap_index);
 }
 
 void TimerManager::TickTimers(time_t ctime)
 {
-	while (Timers.size() && ctime > Timers.front()->GetTimer())
+	while (!Timers.empty() && ctime > Timers.front()->GetTimer())
 	{
 		Timer *t = Timers.front();
 
 		t->Tick(ctime);
 
 		if (t->GetRepeat())
-		{
 			t->SetTimer(ctime + t->GetSecs());
-			sort(Timers.begin(), Timers.end(), TimerManager::TimerComparison);
-		}
 		else
 			delete t;
 	}
@@ -15,6 +15,7 @@
 #include "config.h"
 #include "protocol.h"
 #include "servers.h"
+#include "socketengine.h"
 
 UplinkSocket *UplinkSock = NULL;
 
@@ -53,7 +54,7 @@ void Uplink::Connect()
 }
 
 
-UplinkSocket::UplinkSocket() : Socket(-1, Config->Uplinks[Anope::CurrentUplink]->ipv6), ConnectionSocket(), BufferedSocket()
+UplinkSocket::UplinkSocket() : Socket(-1, Config->Uplinks[Anope::CurrentUplink]->ipv6), ConnectionSocket(), BufferedSocket(), bytes_queued(0), flushes(0), peak_sendq(0)
 {
 	UplinkSock = this;
 }
@@ -122,6 +123,60 @@ bool UplinkSocket::Read(const Anope::string &buf)
 	return true;
 }
 
+void UplinkSocket::Write(const char *buffer, size_t l)
+{
+	this->write_buffer.Append(buffer, l);
+	this->write_buffer.Append("\r\n", 2);
+	this->bytes_queued += l + 2;
+
+	if (this->write_buffer.Length() > this->peak_sendq)
+		this->peak_sendq = this->write_buffer.Length();
+
+	if (this->write_buffer.Length() >= FlushThreshold)
+		this->Flush();
+}
+
+void UplinkSocket::Flush()
+{
+	if (this->write_buffer.Empty())
+		return;
+
+	++this->flushes;
+
+	/* If the engine is not already waiting to write to the socket try writing to it now,
+	 * which often sends everything and saves having the engine watch for writability.
+	 */
+	if (this->HasFlag(SF_CONNECTED) && !this->HasFlag(SF_WRITABLE))
+	{
+		const char *segments[NET_MAXSEGMENTS];
+		size_t lens[NET_MAXSEGMENTS];
+		int count = this->write_buffer.GetSegments(segments, lens, NET_MAXSEGMENTS);
+
+		int written = this->io->Send(this, segments, lens, count);
+		if (written > 0)
+			this->write_buffer.Consume(written);
+	}
+
+	/* Errors are noticed by the engine when it next processes the socket */
+	if (!this->write_buffer.Empty())
+		SocketEngine::Change(this, true, SF_WRITABLE);
+}
+
+unsigned long UplinkSocket::GetBytesQueued() const
+{
+	return this->bytes_queued;
+}
+
+unsigned long UplinkSocket::GetFlushes() const
+{
+	return this->flushes;
+}
+
+size_t UplinkSocket::GetPeakSendQ() const
+{
+	return this->peak_sendq;
+}
+
 void UplinkSocket::OnConnect()
 {
 	Log(LOG_TERMINAL) << "Successfully connected to uplink #" << (Anope::CurrentUplink + 1) << " " << Config->Uplinks[Anope::CurrentUplink]->host << ":" << Config->Uplinks[Anope::CurrentUplink]->port;
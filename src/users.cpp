@@ -101,7 +101,10 @@ void User::ChangeNick(const Anope::string &newnick, time_t ts)
 	{
 		NickAlias *old_na = NickAlias::Find(this->nick);
 		if (old_na && (this->IsIdentified(true) || this->IsRecognized()))
+		{
 			old_na->last_seen = Anope::CurTime;
+			old_na->QueueUpdate();
+		}
 		
 		UserListByNick.erase(this->nick);
 		this->nick = newnick;
@@ -118,6 +121,7 @@ void User::ChangeNick(const Anope::string &newnick, time_t ts)
 		if (na && na->nc == this->Account())
 		{
 			na->last_seen = Anope::CurTime;
+			na->QueueUpdate();
 			this->UpdateHost();
 		}
 	}
@@ -222,7 +226,10 @@ void User::SetRealname(const Anope::string &srealname)
 	NickAlias *na = NickAlias::Find(this->nick);
 
 	if (na && (this->IsIdentified(true) || this->IsRecognized()))
+	{
 		na->last_realname = srealname;
+		na->QueueUpdate();
+	}
 
 	Log(this, "realname") << "changed realname to " << srealname;
 }
@@ -391,6 +398,7 @@ void User::Identify(NickAlias *na)
 		na->last_realhost = last_realhost;
 		na->last_realname = this->realname;
 		na->last_seen = Anope::CurTime;
+		na->QueueUpdate();
 	}
 
 	this->Login(na->nc);
@@ -542,6 +550,7 @@ void User::UpdateHost()
 		Anope::string last_realhost = this->GetIdent() + "@" + this->host;
 		na->last_usermask = last_usermask;
 		na->last_realhost = last_realhost;
+		na->QueueUpdate();
 	}
 }
 
@@ -728,9 +737,9 @@ Anope::string User::GetModes() const
 
 ChannelContainer *User::FindChannel(const Channel *c) const
 {
-	for (UChannelList::const_iterator it = this->chans.begin(), it_end = this->chans.end(); it != it_end; ++it)
-		if ((*it)->chan == c)
-			return *it;
+	UChannelIndex::const_iterator it = this->chans_index.find(c);
+	if (it != this->chans_index.end())
+		return *it->second;
 	return NULL;
 }
 
@@ -759,6 +768,7 @@ void User::KillInternal(const Anope::string &source, const Anope::string &reason
 	{
 		na->last_seen = Anope::CurTime;
 		na->last_quit = reason;
+		na->QueueUpdate();
 	}
 
 	delete this;
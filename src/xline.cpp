@@ -44,20 +44,33 @@ void XLine::InitRegex()
 	}
 }
 
+void XLine::InitMasks()
+{
+	this->compiled_mask.Compile(this->mask);
+	this->compiled_nick.Compile(this->GetNick());
+	this->compiled_user.Compile(this->GetUser());
+	this->compiled_host.Compile(this->GetHost());
+	this->compiled_real.Compile(this->GetReal());
+}
+
 XLine::XLine(const Anope::string &ma, const Anope::string &r, const Anope::string &uid) : Serializable("XLine"), mask(ma), by(Config->OperServ), created(0), expires(0), reason(r), id(uid)
 {
 	regex = NULL;
 	manager = NULL;
+	added = 0;
 
 	this->InitRegex();
+	this->InitMasks();
 }
 
 XLine::XLine(const Anope::string &ma, const Anope::string &b, const time_t ex, const Anope::string &r, const Anope::string &uid) : Serializable("XLine"), mask(ma), by(b), created(Anope::CurTime), expires(ex), reason(r), id(uid)
 {
 	regex = NULL;
 	manager = NULL;
+	added = 0;
 
 	this->InitRegex();
+	this->InitMasks();
 }
 
 XLine::~XLine()
@@ -163,16 +176,27 @@ Serializable* XLine::Unserialize(Serializable *obj, Serialize::Data &data)
 	if (obj)
 	{
 		xl = anope_dynamic_static_cast<XLine *>(obj);
+		/* The mask may change, so take it out of the index until it is recompiled */
+		if (xl->manager)
+			xl->manager->Unindex(xl);
+
 		data["mask"] >> xl->mask;
 		data["by"] >> xl->by;
 		data["reason"] >> xl->reason;
 		data["uid"] >> xl->id;
 
+		delete xl->regex;
+		xl->regex = NULL;
+		xl->InitRegex();
+		xl->InitMasks();
+
 		if (xlm != xl->manager)
 		{
 			xl->manager->DelXLine(xl);
 			xlm->AddXLine(xl);
 		}
+		else
+			xlm->Index(xl);
 	}
 	else
 	{
@@ -250,7 +274,7 @@ Anope::string XLineManager::GenerateUID()
 	return id;
 }
 
-XLineManager::XLineManager(Module *creator, const Anope::string &xname, char t) : Service(creator, "XLineManager", xname), type(t), xlines("XLine")
+XLineManager::XLineManager(Module *creator, const Anope::string &xname, char t) : Service(creator, "XLineManager", xname), type(t), xlines("XLine"), added_count(0), last_expire(0)
 {
 }
 
@@ -280,6 +304,8 @@ void XLineManager::AddXLine(XLine *x)
 		XLinesByUID->insert(std::make_pair(x->id, x));
 	this->xlines->push_back(x);
 	x->manager = this;
+	x->added = ++this->added_count;
+	this->Index(x);
 }
 
 bool XLineManager::DelXLine(XLine *x)
@@ -297,6 +323,8 @@ bool XLineManager::DelXLine(XLine *x)
 			}
 	}
 
+	this->Unindex(x);
+
 	if (it != this->xlines->end())
 	{
 		this->SendDel(x);
@@ -330,6 +358,11 @@ void XLineManager::Clear()
 		x->Destroy();
 	}
 	this->xlines->clear();
+
+	this->hosts.clear();
+	this->host_suffixes.clear();
+	this->ips.clear();
+	this->unindexed.clear();
 }
 
 bool XLineManager::CanAdd(CommandSource &source, const Anope::string &mask, time_t expires, const Anope::string &reason)
@@ -403,12 +436,229 @@ XLine* XLineManager::HasEntry(const Anope::string &mask)
 	return NULL;
 }
 
-XLine *XLineManager::CheckAllXLines(User *u)
+/** Gets the index key of an address
+ * @param addr The address
+ * @param bytes How many bytes of it to use
+ * @return The key
+ */
+static std::string IPKey(const sockaddrs &addr, size_t bytes)
+{
+	std::string key(1, addr.sa.sa_family == AF_INET6 ? '6' : '4');
+	if (addr.sa.sa_family == AF_INET6)
+		key.append(reinterpret_cast<const char *>(&addr.sa6.sin6_addr), std::min(bytes, sizeof(addr.sa6.sin6_addr)));
+	else
+		key.append(reinterpret_cast<const char *>(&addr.sa4.sin_addr), std::min(bytes, sizeof(addr.sa4.sin_addr)));
+	return key;
+}
+
+/** Works out where an xline belongs in the index, which must agree with what Check() can match
+ * @param x The xline
+ * @param host Set to the host if the xline is on a host without wildcards
+ * @param suffix Set to the domain if the xline is on *.domain
+ * @param ip Set to the key of the IP or CIDR range the xline is on
+ * @return false if the xline can not be indexed
+ */
+static bool GetIndexKeys(const XLine *x, Anope::string &host, Anope::string &suffix, std::string &ip)
+{
+	const Anope::string &mask = x->compiled_host.GetMask();
+
+	if (x->regex || mask.empty())
+		return false;
+
+	if (mask.find_first_of("*?") == Anope::string::npos)
+	{
+		host = mask;
+
+		try
+		{
+			/* Check() matches CIDR ranges by the user's IP as well as by their host */
+			cidr range(mask);
+
+			bool ipv6 = mask.find(':') != Anope::string::npos;
+			size_t sl = mask.find_last_of('/');
+			/* Only the whole bytes of the range are used, which narrows it down enough */
+			unsigned char len = sl == Anope::string::npos ? (ipv6 ? 128 : 32) : convertTo<unsigned int>(mask.substr(sl + 1));
+
+			sockaddrs addr;
+			addr.pton(ipv6 ? AF_INET6 : AF_INET, sl == Anope::string::npos ? mask : mask.substr(0, sl));
+			ip = IPKey(addr, len / 8);
+		}
+		catch (const SocketException &) { }
+		catch (const ConvertException &) { }
+
+		return true;
+	}
+
+	if (mask.length() > 2 && mask[0] == '*' && mask[1] == '.' && mask.find_first_of("*?", 1) == Anope::string::npos)
+	{
+		suffix = mask.substr(1);
+		return true;
+	}
+
+	return false;
+}
+
+void XLineManager::Index(XLine *x)
+{
+	if (!this->IsHostBased())
+		return;
+
+	Anope::string host, suffix;
+	std::string ip;
+
+	if (!GetIndexKeys(x, host, suffix, ip))
+	{
+		this->unindexed.push_back(x);
+		return;
+	}
+
+	if (!host.empty())
+		this->hosts[host].push_back(x);
+	if (!suffix.empty())
+		this->host_suffixes[suffix].push_back(x);
+	if (!ip.empty())
+		this->ips[ip].push_back(x);
+}
+
+/** Removes an xline from a bucket of the index
+ * @param bucket The bucket
+ * @param x The xline
+ * @return true if the bucket is now empty
+ */
+static bool RemoveFromBucket(std::vector<XLine *> &bucket, XLine *x)
+{
+	std::vector<XLine *>::iterator it = std::find(bucket.begin(), bucket.end(), x);
+	if (it != bucket.end())
+		bucket.erase(it);
+	return bucket.empty();
+}
+
+void XLineManager::Unindex(XLine *x)
+{
+	if (!this->IsHostBased())
+		return;
+
+	Anope::string host, suffix;
+	std::string ip;
+
+	if (!GetIndexKeys(x, host, suffix, ip))
+	{
+		RemoveFromBucket(this->unindexed, x);
+		return;
+	}
+
+	if (!host.empty())
+	{
+		Anope::hash_map<xline_bucket>::iterator it = this->hosts.find(host);
+		if (it != this->hosts.end() && RemoveFromBucket(it->second, x))
+			this->hosts.erase(it);
+	}
+	if (!suffix.empty())
+	{
+		Anope::hash_map<xline_bucket>::iterator it = this->host_suffixes.find(suffix);
+		if (it != this->host_suffixes.end() && RemoveFromBucket(it->second, x))
+			this->host_suffixes.erase(it);
+	}
+	if (!ip.empty())
+	{
+		std::map<std::string, xline_bucket>::iterator it = this->ips.find(ip);
+		if (it != this->ips.end() && RemoveFromBucket(it->second, x))
+			this->ips.erase(it);
+	}
+}
+
+void XLineManager::Expire()
 {
 	for (unsigned i = this->xlines->size(); i > 0; --i)
 	{
 		XLine *x = this->xlines->at(i - 1);
 
+		if (x->expires && x->expires < Anope::CurTime)
+		{
+			this->OnExpire(x);
+			this->DelXLine(x);
+		}
+	}
+}
+
+/* Orders xlines newest first, which is the order they are checked in */
+static bool NewerXLine(const XLine *x1, const XLine *x2)
+{
+	return x1->added > x2->added;
+}
+
+XLine *XLineManager::CheckAllXLines(User *u)
+{
+	if (!this->IsHostBased())
+	{
+		for (unsigned i = this->xlines->size(); i > 0; --i)
+		{
+			XLine *x = this->xlines->at(i - 1);
+
+			if (x->expires && x->expires < Anope::CurTime)
+			{
+				this->OnExpire(x);
+				this->DelXLine(x);
+				continue;
+			}
+
+			if (this->Check(u, x))
+			{
+				this->OnMatch(u, x);
+				return x;
+			}
+		}
+
+		return NULL;
+	}
+
+	/* Xlines which can not match this user are never looked at below, so expire everything
+	 * here instead, but only once a second as there may be many users being checked at once
+	 */
+	if (this->last_expire != Anope::CurTime)
+	{
+		this->last_expire = Anope::CurTime;
+		this->Expire();
+	}
+
+	std::vector<XLine *> candidates(this->unindexed);
+
+	Anope::hash_map<xline_bucket>::const_iterator hit = this->hosts.find(u->host);
+	if (hit != this->hosts.end())
+		candidates.insert(candidates.end(), hit->second.begin(), hit->second.end());
+
+	for (size_t dot = u->host.find('.'); dot != Anope::string::npos; dot = u->host.find('.', dot + 1))
+	{
+		hit = this->host_suffixes.find(u->host.substr(dot));
+		if (hit != this->host_suffixes.end())
+			candidates.insert(candidates.end(), hit->second.begin(), hit->second.end());
+	}
+
+	if (!this->ips.empty())
+	{
+		try
+		{
+			sockaddrs ip(u->ip);
+			size_t bytes = ip.sa.sa_family == AF_INET6 ? sizeof(ip.sa6.sin6_addr) : sizeof(ip.sa4.sin_addr);
+
+			for (size_t i = 0; i <= bytes; ++i)
+			{
+				std::map<std::string, xline_bucket>::const_iterator iit = this->ips.find(IPKey(ip, i));
+				if (iit != this->ips.end())
+					candidates.insert(candidates.end(), iit->second.begin(), iit->second.end());
+			}
+		}
+		catch (const SocketException &) { }
+	}
+
+	/* Check them in the same order a check of every xline would, so the same one matches */
+	std::sort(candidates.begin(), candidates.end(), NewerXLine);
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	for (unsigned i = 0; i < candidates.size(); ++i)
+	{
+		XLine *x = candidates[i];
+
 		if (x->expires && x->expires < Anope::CurTime)
 		{
 			this->OnExpire(x);
@@ -426,6 +676,11 @@ XLine *XLineManager::CheckAllXLines(User *u)
 	return NULL;
 }
 
+bool XLineManager::IsHostBased() const
+{
+	return false;
+}
+
 void XLineManager::OnExpire(const XLine *x)
 {
 }